@@ -30,6 +30,24 @@ def parse_arg():
         default='std',
         help='Pick a format lib to support. Can be `std`(for standard library) or `fmtlib`(for `https://fmt.dev/`)',
     )
+    parser.add_argument('--count-allocs',
+        dest='count_allocs',
+        action='store_true',
+        default=False,
+        help='Count heap allocations by replacing global operator new and delete.',
+    )
+    parser.add_argument('--coverage',
+        dest='coverage',
+        action='store_true',
+        default=False,
+        help='Instrument by gcov, so that runtests.py can record coverage of cases.',
+    )
+    parser.add_argument('--fuzz',
+        dest='fuzz',
+        action='store_true',
+        default=False,
+        help='Instrument cases for coverage-guided fuzzing by `--fuzz` of test executables.',
+    )
     args = parser.parse_args()
     return args
 
@@ -48,6 +66,12 @@ def plan(args):
         cmd += ['-DFMTLIB=fmtlib']
     else:
         raise Exception(f'unsupported fmtlib: {args.fmtlib}')
+    if args.count_allocs:
+        cmd += ['-DTESTA_COUNT_ALLOCS=ON']
+    if args.coverage:
+        cmd += ['-DTESTA_COVERAGE=ON']
+    if args.fuzz:
+        cmd += ['-DTESTA_FUZZ=ON']
     cmd += ['../..']
 
     if args.prune and build_dir.exists():
@@ -0,0 +1,124 @@
+// A micro-benchmark on how fast testbench inputs reach trial and oracle functions.
+// The legacy dispatch, which EqCase used to do, is reproduced here for comparison.
+// Trial and oracle functions are cheap but never inlined,
+// so the cost of dispatch dominates.
+#include "testa.hpp"
+#include "prettyprint.hpp"
+#include <chrono>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <cstdio>
+
+using namespace std;
+
+namespace {
+
+constexpr int kInputs = 20000000;
+
+__attribute__((noinline)) int multiply_trial(const tuple<int, int>& in)
+{
+    return get<0>(in) * get<1>(in);
+}
+
+__attribute__((noinline)) int multiply_oracle(const tuple<int, int>& in)
+{
+    return get<1>(in) * get<0>(in);
+}
+
+__attribute__((noinline)) size_t length_trial(const tuple<string, int>& in)
+{
+    return get<0>(in).size() + get<1>(in);
+}
+
+__attribute__((noinline)) size_t length_oracle(const tuple<string, int>& in)
+{
+    return get<1>(in) + get<0>(in).size();
+}
+
+template<class Res, class T>
+void legacy_eq(Res (*trialFn)(const T&), Res (*oracleFn)(const T&), const T& in)
+{
+    const Res& trialResult = trialFn(in);
+    const Res& oracleResult = oracleFn(in);
+    TESTA_ASSERT(trialResult == oracleResult)
+        .hint("input={}", in)
+        .hint("trial result={}", trialResult)
+        .hint("oracle result={}", oracleResult)
+        .issue();
+}
+
+template<class Res, class T>
+function<void()> legacy_case(
+    void (*tb)(const string&, function<void(const T&)>),
+    Res (*trialFn)(const T&),
+    Res (*oracleFn)(const T&)
+) {
+    function<void(T)> cs = bind(&legacy_eq<Res, T>, trialFn, oracleFn, placeholders::_1);
+    return bind(tb, string("legacy"), cs);
+}
+
+void int_tb(const string&, function<void(const tuple<int, int>&)> cs)
+{
+    for(int i = 0; i < kInputs; ++i) {
+        cs(make_tuple(i & 1023, i >> 10));
+    }
+}
+
+auto int_template_tb = [](const string&, const auto& cs) {
+    for(int i = 0; i < kInputs; ++i) {
+        cs(make_tuple(i & 1023, i >> 10));
+    }
+};
+
+const tuple<string, int> kStrInput("a string that does not fit in small buffers", 1);
+
+void str_tb(const string&, function<void(const tuple<string, int>&)> cs)
+{
+    for(int i = 0; i < kInputs; ++i) {
+        cs(kStrInput);
+    }
+}
+
+auto str_template_tb = [](const string&, const auto& cs) {
+    for(int i = 0; i < kInputs; ++i) {
+        cs(kStrInput);
+    }
+};
+
+template<class Fn>
+void measure(const char* title, const Fn& fn)
+{
+    auto start = chrono::steady_clock::now();
+    fn();
+    chrono::duration<double> dur = chrono::steady_clock::now() - start;
+    printf("%-50s %8.2f M inputs/sec\n", title, kInputs / dur.count() / 1e6);
+}
+
+}
+
+int main()
+{
+    auto intCheck = testa::_impl::EqCheck{
+        TESTA_IMPL_FN(multiply_trial),
+        TESTA_IMPL_FN(multiply_oracle)};
+    auto strCheck = testa::_impl::EqCheck{
+        TESTA_IMPL_FN(length_trial),
+        TESTA_IMPL_FN(length_oracle)};
+
+    measure("tuple<int, int>, legacy", legacy_case(int_tb, multiply_trial, multiply_oracle));
+    measure("tuple<int, int>, EqCheck by std::function tb", [&]() {
+        int_tb("", intCheck);
+    });
+    measure("tuple<int, int>, EqCheck by template tb", [&]() {
+        int_template_tb("", intCheck);
+    });
+    measure("tuple<string, int>, legacy", legacy_case(str_tb, length_trial, length_oracle));
+    measure("tuple<string, int>, EqCheck by std::function tb", [&]() {
+        str_tb("", strCheck);
+    });
+    measure("tuple<string, int>, EqCheck by template tb", [&]() {
+        str_template_tb("", strCheck);
+    });
+    return 0;
+}
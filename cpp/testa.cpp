@@ -1,9 +1,24 @@
 #include "testa.hpp"
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
 #include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string_view>
+#include <thread>
 #include <cstdlib>
 #include <cstdio>
+#include <new>
+#include <malloc.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
 
 using namespace std;
 
@@ -14,12 +29,513 @@ using std::format_to;
 using fmt::format_to;
 #endif
 
+namespace testa {
+
+const char* to_string(Isolation iso)
+{
+    switch (iso) {
+    case Isolation::Pure:
+        return "pure";
+    case Isolation::Unit:
+        return "unit";
+    case Isolation::Smoke:
+        return "smoke";
+    case Isolation::Functional:
+        return "functional";
+    }
+    abort();
+}
+
+namespace {
+
+constexpr char kCorpusMagic[8] = {'T', 'E', 'S', 'T', 'A', 'C', 'P', '1'};
+
+string exe_dir()
+{
+    char buf[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf));
+    if (n <= 0 || size_t(n) >= sizeof(buf)) {
+        return ".";
+    }
+    string_view exe(buf, n);
+    return string(exe.substr(0, exe.rfind('/')));
+}
+
+}
+
+Corpus::Corpus(const string& path)
+:   _map(nullptr),
+    _mapSize(0)
+{
+    string fn = (!path.empty() && path[0] == '/') ? path : exe_dir() + "/" + path;
+    int fd = open(fn.c_str(), O_RDONLY | O_CLOEXEC);
+    TESTA_ASSERT(fd >= 0)
+        .hint("file={}", fn)
+        .issue("cannot open corpus");
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            _map = static_cast<const char*>(p);
+            _mapSize = st.st_size;
+        }
+    }
+    close(fd);
+    bool isCorpus = _mapSize >= sizeof(kCorpusMagic)
+        && memcmp(_map, kCorpusMagic, sizeof(kCorpusMagic)) == 0;
+    if (!isCorpus && _map != nullptr) {
+        munmap(const_cast<char*>(_map), _mapSize);
+    }
+    TESTA_ASSERT(isCorpus)
+        .hint("file={}", fn)
+        .issue("not a corpus");
+    // Only lengths are read, in a sequential pass.
+    madvise(const_cast<char*>(_map), _mapSize, MADV_SEQUENTIAL);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(_map);
+    size_t off = sizeof(kCorpusMagic);
+    while(off < _mapSize) {
+        bool complete = _mapSize - off >= 4;
+        uint32_t len = 0;
+        if (complete) {
+            len = p[off] | (p[off + 1] << 8) | (p[off + 2] << 16) | (uint32_t(p[off + 3]) << 24);
+            complete = _mapSize - off - 4 >= len;
+        }
+        if (!complete) {
+            munmap(const_cast<char*>(_map), _mapSize);
+        }
+        TESTA_ASSERT(complete)
+            .hint("file={}", fn)
+            .hint("record={}, offset={}", _records.size(), off)
+            .issue("truncated corpus");
+        _records.push_back(off);
+        off += 4 + len;
+    }
+    madvise(const_cast<char*>(_map), _mapSize, MADV_NORMAL);
+}
+
+Corpus::~Corpus()
+{
+    if (_map != nullptr) {
+        munmap(const_cast<char*>(_map), _mapSize);
+    }
+}
+
+void Corpus::prefetch(size_t first, size_t last) const
+{
+    if (first >= last) {
+        return;
+    }
+    size_t begin = _records[first];
+    size_t end = (last < _records.size()) ? _records[last] : _mapSize;
+    size_t page = sysconf(_SC_PAGESIZE);
+    begin -= begin % page;
+    madvise(const_cast<char*>(_map) + begin, end - begin, MADV_WILLNEED);
+}
+
+CorpusWriter::CorpusWriter(const string& path)
+:   _path(path),
+    _fp(fopen(path.c_str(), "wb"))
+{
+    TESTA_ASSERT(_fp != nullptr && fwrite(kCorpusMagic, sizeof(kCorpusMagic), 1, _fp) == 1)
+        .hint("file={}", _path)
+        .issue("cannot write corpus");
+}
+
+CorpusWriter::~CorpusWriter()
+{
+    if (_fp != nullptr) {
+        fclose(_fp);
+    }
+}
+
+void CorpusWriter::add(string_view record)
+{
+    TESTA_ASSERT(record.size() <= UINT32_MAX)
+        .hint("size={}", record.size())
+        .issue("a record of corpus is at most 4GB");
+    uint32_t len = record.size();
+    unsigned char prefix[4] = {
+        (unsigned char) len,
+        (unsigned char) (len >> 8),
+        (unsigned char) (len >> 16),
+        (unsigned char) (len >> 24),
+    };
+    TESTA_ASSERT(fwrite(prefix, 4, 1, _fp) == 1 && fwrite(record.data(), 1, record.size(), _fp) == record.size())
+        .hint("file={}", _path)
+        .issue("cannot write corpus");
+}
+
+void CorpusWriter::close()
+{
+    FILE* fp = _fp;
+    _fp = nullptr;
+    TESTA_ASSERT(fp != nullptr && fclose(fp) == 0)
+        .hint("file={}", _path)
+        .issue("cannot write corpus");
+}
+
+namespace {
+
+// Counters are constant-initialized,
+// so they work even for allocations before main().
+struct ProcessAllocs {
+    atomic<uint64_t> allocs;
+    atomic<uint64_t> frees;
+    atomic<uint64_t> bytes;
+    atomic<int64_t> live;
+    atomic<int64_t> peak;
+};
+
+constinit ProcessAllocs gProcessAllocs = {};
+constinit thread_local AllocCounters tThreadAllocs = {};
+constinit thread_local const AllocScope* tAllocScope = nullptr;
+
+[[maybe_unused]] void count_alloc(void* p)
+{
+    if (p == nullptr) {
+        return;
+    }
+    int64_t sz = malloc_usable_size(p);
+    gProcessAllocs.allocs.fetch_add(1, memory_order_relaxed);
+    gProcessAllocs.bytes.fetch_add(sz, memory_order_relaxed);
+    int64_t live = gProcessAllocs.live.fetch_add(sz, memory_order_relaxed) + sz;
+    int64_t peak = gProcessAllocs.peak.load(memory_order_relaxed);
+    while (live > peak && !gProcessAllocs.peak.compare_exchange_weak(peak, live, memory_order_relaxed)) {
+    }
+
+    AllocCounters& th = tThreadAllocs;
+    ++th.allocs;
+    th.bytes += sz;
+    th.live += sz;
+    th.peak = max(th.peak, th.live);
+}
+
+[[maybe_unused]] void count_free(void* p)
+{
+    if (p == nullptr) {
+        return;
+    }
+    int64_t sz = malloc_usable_size(p);
+    gProcessAllocs.frees.fetch_add(1, memory_order_relaxed);
+    gProcessAllocs.live.fetch_sub(sz, memory_order_relaxed);
+
+    AllocCounters& th = tThreadAllocs;
+    ++th.frees;
+    th.live -= sz;
+}
+
+}
+
+bool alloc_counting()
+{
+#ifdef TESTA_COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocCounters process_allocs()
+{
+    AllocCounters res;
+    res.allocs = gProcessAllocs.allocs.load(memory_order_relaxed);
+    res.frees = gProcessAllocs.frees.load(memory_order_relaxed);
+    res.bytes = gProcessAllocs.bytes.load(memory_order_relaxed);
+    res.live = gProcessAllocs.live.load(memory_order_relaxed);
+    res.peak = gProcessAllocs.peak.load(memory_order_relaxed);
+    return res;
+}
+
+AllocCounters thread_allocs()
+{
+    return tThreadAllocs;
+}
+
+AllocScope::AllocScope()
+:   _start(tThreadAllocs),
+    _outer(tAllocScope)
+{
+    tThreadAllocs.peak = tThreadAllocs.live;
+    tAllocScope = this;
+}
+
+AllocScope::~AllocScope()
+{
+    tThreadAllocs.peak = max(tThreadAllocs.peak, _start.peak);
+    tAllocScope = _outer;
+}
+
+const AllocScope* AllocScope::innermost()
+{
+    return tAllocScope;
+}
+
+AllocCounters AllocScope::counters() const
+{
+    const AllocCounters& now = tThreadAllocs;
+    AllocCounters res;
+    res.allocs = now.allocs - _start.allocs;
+    res.frees = now.frees - _start.frees;
+    res.bytes = now.bytes - _start.bytes;
+    res.live = now.live - _start.live;
+    res.peak = now.peak - _start.live;
+    return res;
+}
+
+}
+
+#ifdef TESTA_COUNT_ALLOCS
+
+// Replacements of global allocation functions.
+// malloc() is left alone, for it is interposed by sanitizers already.
+
+namespace {
+
+void* counted_new(size_t sz, size_t align, bool nothrow)
+{
+    for(;;) {
+        void* p = (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+            ? malloc(max<size_t>(sz, 1))
+            : aligned_alloc(align, (max<size_t>(sz, 1) + align - 1) / align * align);
+        if (p != nullptr) {
+            testa::count_alloc(p);
+            return p;
+        }
+        new_handler h = get_new_handler();
+        if (h == nullptr) {
+            if (nothrow) {
+                return nullptr;
+            }
+            throw bad_alloc();
+        }
+        h();
+    }
+}
+
+void counted_delete(void* p)
+{
+    testa::count_free(p);
+    free(p);
+}
+
+}
+
+void* operator new(size_t sz)
+{
+    return counted_new(sz, 0, false);
+}
+
+void* operator new[](size_t sz)
+{
+    return counted_new(sz, 0, false);
+}
+
+void* operator new(size_t sz, const nothrow_t&) noexcept
+{
+    try {
+        return counted_new(sz, 0, true);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t sz, const nothrow_t&) noexcept
+{
+    try {
+        return counted_new(sz, 0, true);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new(size_t sz, align_val_t al)
+{
+    return counted_new(sz, size_t(al), false);
+}
+
+void* operator new[](size_t sz, align_val_t al)
+{
+    return counted_new(sz, size_t(al), false);
+}
+
+void* operator new(size_t sz, align_val_t al, const nothrow_t&) noexcept
+{
+    try {
+        return counted_new(sz, size_t(al), true);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t sz, align_val_t al, const nothrow_t&) noexcept
+{
+    try {
+        return counted_new(sz, size_t(al), true);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete(void* p, const nothrow_t&) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete[](void* p, const nothrow_t&) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete(void* p, align_val_t) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete[](void* p, align_val_t) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete(void* p, size_t, align_val_t) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete[](void* p, size_t, align_val_t) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete(void* p, align_val_t, const nothrow_t&) noexcept
+{
+    counted_delete(p);
+}
+
+void operator delete[](void* p, align_val_t, const nothrow_t&) noexcept
+{
+    counted_delete(p);
+}
+
+#endif
+
 namespace testa::_impl {
 
-shared_ptr<CaseMap> get_case_map()
+// Bounds of section `testa_cases`, provided by the linker.
+// They are weak, in case of no case at all.
+extern "C" {
+extern CaseDesc __start_testa_cases[] __attribute__((weak));
+extern CaseDesc __stop_testa_cases[] __attribute__((weak));
+extern DepsDesc __start_testa_deps[] __attribute__((weak));
+extern DepsDesc __stop_testa_deps[] __attribute__((weak));
+}
+
+span<const CaseDesc> all_cases()
+{
+    if (__start_testa_cases == nullptr) {
+        return span<const CaseDesc>();
+    }
+    return span<const CaseDesc>(__start_testa_cases, __stop_testa_cases);
+}
+
+namespace {
+
+// An open-addressing hash table of indices into all_cases(),
+// keyed by hashes computed at compile time.
+class CaseIndex {
+public:
+    CaseIndex()
+    :   _cases(all_cases())
+    {
+        size_t cap = 1;
+        while (cap < _cases.size() * 2) {
+            cap *= 2;
+        }
+        _mask = cap - 1;
+        _slots.assign(cap, kEmpty);
+        for(size_t i = 0; i < _cases.size(); ++i) {
+            size_t s = _cases[i].hash & _mask;
+            while (_slots[s] != kEmpty) {
+                s = (s + 1) & _mask;
+            }
+            _slots[s] = i;
+        }
+    }
+
+    const CaseDesc* find(string_view name) const
+    {
+        uint64_t h = case_hash(name);
+        for(size_t s = h & _mask; _slots[s] != kEmpty; s = (s + 1) & _mask) {
+            const CaseDesc& cs = _cases[_slots[s]];
+            if (cs.hash == h && name == cs.name) {
+                return &cs;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    static constexpr size_t kEmpty = SIZE_MAX;
+
+    span<const CaseDesc> _cases;
+    vector<size_t> _slots;
+    size_t _mask;
+};
+
+}
+
+const CaseDesc* find_case(string_view name)
+{
+    static const CaseIndex index;
+    return index.find(name);
+}
+
+const DepsDesc* find_deps(string_view name)
+{
+    if (__start_testa_deps == nullptr) {
+        return nullptr;
+    }
+    for(const DepsDesc* d = __start_testa_deps; d != __stop_testa_deps; ++d) {
+        if (name == d->name) {
+            return d;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+
+InputRange gSelectedInputs;
+
+}
+
+const InputRange& selected_inputs()
+{
+    return gSelectedInputs;
+}
+
+void select_inputs(const InputRange& range)
 {
-    static shared_ptr<CaseMap> result(new CaseMap());
-    return result;
+    gSelectedInputs = range;
 }
 
 CaseFailIssuer::CaseFailIssuer(const char* cond, const char* fn, int line)
@@ -29,6 +545,29 @@ CaseFailIssuer::CaseFailIssuer(const char* cond, const char* fn, int line)
     _issued(false)
 {}
 
+CaseFailIssuer::CaseFailIssuer(CaseFailIssuer&& ano)
+:   _condition(ano._condition),
+    _filename(ano._filename),
+    _line(ano._line),
+    _hints(std::move(ano._hints)),
+    _issued(ano._issued)
+{
+    ano._issued = true;
+}
+
+CaseFailIssuer& CaseFailIssuer::operator=(CaseFailIssuer&& ano)
+{
+    if (this != &ano) {
+        _condition = ano._condition;
+        _filename = ano._filename;
+        _line = ano._line;
+        _hints = std::move(ano._hints);
+        _issued = ano._issued;
+        ano._issued = true;
+    }
+    return *this;
+}
+
 CaseFailIssuer::~CaseFailIssuer()
 {
     if (!_issued) {
@@ -61,7 +600,670 @@ void CaseFailIssuer::issue(const string_view& msg) &&
     for (; h_it != _hints.end(); ++h_it) {
         it = format_to(it, "       {}\n", *h_it);
     }
+    if (tInputIndex != SIZE_MAX) {
+        it = format_to(it, "Input index: {}{}, to be replayed by `--input {}`\n",
+            tInputIndex, (tShrinkIndex != SIZE_MAX) ? " (shrunk)" : "", tInputIndex);
+    }
+    if (alloc_counting()) {
+        // of the failed input, or the case, by the calling thread.
+        const AllocScope* scope = AllocScope::innermost();
+        AllocCounters cnt = (scope != nullptr) ? scope->counters() : thread_allocs();
+        it = format_to(it, "Allocs: {} allocations, {} frees, {} bytes in total, {} bytes at peak\n",
+            cnt.allocs, cnt.frees, cnt.bytes, cnt.peak);
+    }
     throw std::logic_error(full_msg);
 }
 
+struct ChunkPool::Impl {
+    vector<thread> threads;
+    mutex mtx;
+    condition_variable hasChunk;
+    condition_variable hasRoom;
+    condition_variable idle;
+    deque<function<void()>> chunks;
+    size_t running = 0;
+    bool stopped = false;
+    exception_ptr failure;
+};
+
+size_t pool_threads()
+{
+    const char* env = getenv("TESTA_THREADS");
+    if (env != nullptr) {
+        long n = strtol(env, nullptr, 10);
+        if (n > 0) {
+            return n;
+        }
+    }
+    return max(1u, thread::hardware_concurrency());
+}
+
+ChunkPool::ChunkPool()
+:   _failedIdx(SIZE_MAX),
+    _impl(new Impl())
+{
+    size_t n = tInlinePools ? 0 : pool_threads();
+    for(size_t i = 0; i < n; ++i) {
+        _impl->threads.emplace_back([this]() {
+            unique_lock<mutex> lk(_impl->mtx);
+            for(;;) {
+                _impl->hasChunk.wait(lk, [this]() {
+                    return _impl->stopped || !_impl->chunks.empty();
+                });
+                if (_impl->chunks.empty()) {
+                    break;
+                }
+                auto chunk = std::move(_impl->chunks.front());
+                _impl->chunks.pop_front();
+                ++_impl->running;
+                _impl->hasRoom.notify_one();
+                lk.unlock();
+                chunk();
+                lk.lock();
+                --_impl->running;
+                if (_impl->running == 0 && _impl->chunks.empty()) {
+                    _impl->idle.notify_all();
+                }
+            }
+        });
+    }
+}
+
+ChunkPool::~ChunkPool()
+{
+    {
+        lock_guard<mutex> lk(_impl->mtx);
+        _impl->stopped = true;
+        _impl->chunks.clear();
+    }
+    _impl->hasChunk.notify_all();
+    for(auto& t: _impl->threads) {
+        t.join();
+    }
+}
+
+size_t ChunkPool::threads() const
+{
+    return max<size_t>(1, _impl->threads.size());
+}
+
+void ChunkPool::submit(function<void()> chunk)
+{
+    if (_impl->threads.empty()) {
+        chunk();
+        return;
+    }
+    unique_lock<mutex> lk(_impl->mtx);
+    _impl->hasRoom.wait(lk, [this]() {
+        return _impl->chunks.size() < 4 * _impl->threads.size();
+    });
+    _impl->chunks.push_back(std::move(chunk));
+    _impl->hasChunk.notify_one();
+}
+
+void ChunkPool::wait()
+{
+    unique_lock<mutex> lk(_impl->mtx);
+    _impl->idle.wait(lk, [this]() {
+        return _impl->running == 0 && _impl->chunks.empty();
+    });
+    if (_impl->failure) {
+        rethrow_exception(_impl->failure);
+    }
+}
+
+void ChunkPool::fail(size_t idx, exception_ptr ex)
+{
+    lock_guard<mutex> lk(_impl->mtx);
+    if (idx < _failedIdx.load(memory_order_relaxed)) {
+        _failedIdx.store(idx, memory_order_relaxed);
+        _impl->failure = ex;
+    }
+}
+
+string json_escape(string_view s)
+{
+    string res;
+    for(char c: s) {
+        switch (c) {
+        case '"':
+            res += "\\\"";
+            break;
+        case '\\':
+            res += "\\\\";
+            break;
+        case '\n':
+            res += "\\n";
+            break;
+        case '\t':
+            res += "\\t";
+            break;
+        default:
+            if ((unsigned char) c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", (unsigned) c);
+                res += buf;
+            } else {
+                res += c;
+            }
+        }
+    }
+    return res;
+}
+
+void emit_record(string_view kind, const string& json)
+{
+    string line;
+    format_to(back_inserter(line), "##testa:{} {}\n", kind, json);
+    if (tRecordSink != nullptr) {
+        *tRecordSink += line;
+        return;
+    }
+    fflush(stdout);
+    fwrite(line.data(), 1, line.size(), stdout);
+    fflush(stdout);
+}
+
+namespace {
+
+constexpr double kBenchWarmup = 0.1;
+constexpr double kBenchSampleTime = 0.01;
+constexpr size_t kBenchSamples = 30;
+// Calibration gives up beyond these, e.g., on a body optimized away.
+constexpr uint64_t kBenchMaxIters = uint64_t(1) << 40;
+constexpr double kBenchMaxCalibration = 10;
+
+double median_of(vector<double> xs)
+{
+    sort(xs.begin(), xs.end());
+    size_t n = xs.size();
+    if (n % 2 == 1) {
+        return xs[n / 2];
+    }
+    return (xs[n / 2 - 1] + xs[n / 2]) / 2;
+}
+
+}
+
+void run_bench(const char* caseName, const function<double(uint64_t)>& loop)
+{
+    // calibrate, while warming up
+    uint64_t iters = 1;
+    double elapsed = 0;
+    double t = 0;
+    for(;;) {
+        t = loop(iters);
+        elapsed += t;
+        if (t >= kBenchSampleTime || iters >= kBenchMaxIters || elapsed >= kBenchMaxCalibration) {
+            break;
+        }
+        if (t < kBenchSampleTime / 10) {
+            iters *= 10;
+        } else {
+            iters = (uint64_t) ceil(iters * kBenchSampleTime / t);
+        }
+        iters = min(iters, kBenchMaxIters);
+    }
+    TESTA_ASSERT(t >= kBenchSampleTime)
+        .hint("{}: a sample of {} iterations takes {:.6f} secs, never reaching {:.3f} secs",
+            caseName, iters, t, kBenchSampleTime)
+        .issue("calibration fails. Is the body optimized away?");
+    while (elapsed < kBenchWarmup) {
+        elapsed += loop(iters);
+    }
+
+    vector<double> samples;
+    for(size_t i = 0; i < kBenchSamples; ++i) {
+        samples.push_back(loop(iters) * 1e9 / iters);
+    }
+    double median = median_of(samples);
+    vector<double> devs;
+    for(double x: samples) {
+        devs.push_back(fabs(x - median));
+    }
+    double mad = median_of(devs);
+    auto [minIt, maxIt] = minmax_element(samples.begin(), samples.end());
+
+    printf("%s: median %.3f ns/op, mad %.3f ns/op, min %.3f ns/op, "
+        "%zu samples of %llu iterations\n",
+        caseName, median, mad, *minIt, samples.size(), (unsigned long long) iters);
+    string json;
+    format_to(back_inserter(json),
+        "{{\"name\":\"{}\",\"unit\":\"ns/op\",\"iterations\":{},\"samples\":{},"
+        "\"median\":{:.3f},\"mad\":{:.3f},\"min\":{:.3f},\"max\":{:.3f}}}",
+        caseName, iters, samples.size(), median, mad, *minIt, *maxIt);
+    emit_record("bench", json);
+}
+
+namespace {
+
+// Seconds of a single pass, by the fastest of a few samples,
+// each of which repeats passes until it takes kBenchSampleTime.
+// Returns 0 if the pass is too fast to be measured.
+double time_pass(const SpeedupMeter::Pass& pass)
+{
+    constexpr int kSamples = 3;
+    auto sample = [&pass](uint64_t reps) {
+        auto start = chrono::steady_clock::now();
+        for(uint64_t i = 0; i < reps; ++i) {
+            pass();
+        }
+        chrono::duration<double> dur = chrono::steady_clock::now() - start;
+        return dur.count();
+    };
+    uint64_t reps = 1;
+    double elapsed = 0;
+    double t = 0;
+    for(;;) {
+        t = sample(reps);
+        elapsed += t;
+        if (t >= kBenchSampleTime || reps >= kBenchMaxIters || elapsed >= kBenchMaxCalibration) {
+            break;
+        }
+        if (t < kBenchSampleTime / 10) {
+            reps *= 10;
+        } else {
+            reps = (uint64_t) ceil(reps * kBenchSampleTime / t);
+        }
+        reps = min(reps, kBenchMaxIters);
+    }
+    if (t < kBenchSampleTime) {
+        return 0;
+    }
+    for(int i = 1; i < kSamples; ++i) {
+        t = min(t, sample(reps));
+    }
+    return t / reps;
+}
+
+}
+
+SpeedupMeter::SpeedupMeter(double speedup)
+:   _speedup(speedup)
+{}
+
+void SpeedupMeter::check(const char* caseName) const
+{
+    struct Times {
+        double trial;
+        double oracle;
+    };
+    map<string, Times> times;
+    for(const auto& [cls, c]: _classes) {
+        times[cls] = {time_pass(c.trial), time_pass(c.oracle)};
+    }
+
+    string json;
+    auto it = back_inserter(json);
+    it = format_to(it, "{{\"name\":\"{}\",\"required\":{},\"classes\":[", caseName, _speedup);
+    bool first = true;
+    for(const auto& [cls, c]: _classes) {
+        if (!first) {
+            it = format_to(it, ",");
+        }
+        first = false;
+        it = format_to(it,
+            "{{\"class\":\"{}\",\"inputs\":{},\"trial\":{:.9f},\"oracle\":{:.9f}}}",
+            json_escape(cls), c.count, times[cls].trial, times[cls].oracle);
+    }
+    it = format_to(it, "]}}");
+    emit_record("speedup", json);
+
+    for(const auto& [cls, c]: _classes) {
+        const Times& t = times[cls];
+        TESTA_ASSERT(t.trial > 0 && t.oracle > 0)
+            .hint("class={}", cls)
+            .hint("inputs={}", c.count)
+            .hint("trial={:.6f} us, oracle={:.6f} us per pass, 0 for unmeasurable", t.trial * 1e6, t.oracle * 1e6)
+            .issue("too fast to be measured. Is the body optimized away?");
+        double speedup = t.oracle / t.trial;
+        string msg;
+        format_to(back_inserter(msg), "trial is {:.2f} times as fast as oracle, less than {}",
+            speedup, _speedup);
+        TESTA_ASSERT(speedup >= _speedup)
+            .hint("class={}", cls)
+            .hint("inputs={}", c.count)
+            .hint("trial={:.3f} us", t.trial * 1e6)
+            .hint("oracle={:.3f} us", t.oracle * 1e6)
+            .issue(msg);
+    }
+}
+
+LatencyHistogram::LatencyHistogram()
+:   _counts(kBuckets, 0),
+    _count(0),
+    _sum(0),
+    _min(UINT64_MAX),
+    _max(0)
+{}
+
+uint64_t LatencyHistogram::lowest_of(size_t idx)
+{
+    if (idx < (2u << kSubBits)) {
+        return idx;
+    }
+    int e = (idx >> kSubBits) - 1;
+    return uint64_t(idx - (size_t(e) << kSubBits)) << e;
+}
+
+uint64_t LatencyHistogram::highest_of(size_t idx)
+{
+    if (idx + 1 >= kBuckets) {
+        return UINT64_MAX;
+    }
+    return lowest_of(idx + 1) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const
+{
+    if (_count == 0) {
+        return 0;
+    }
+    uint64_t rank = max<uint64_t>(1, (uint64_t) ceil(q * _count));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < _counts.size(); ++i) {
+        seen += _counts[i];
+        if (seen >= rank) {
+            return min(highest_of(i), _max);
+        }
+    }
+    return _max;
+}
+
+string LatencyHistogram::to_json() const
+{
+    string json;
+    auto it = back_inserter(json);
+    it = format_to(it, "\"count\":{},\"min\":{},\"max\":{},\"mean\":{:.1f},",
+        _count, (_count == 0) ? 0 : _min, _max, (_count == 0) ? 0.0 : double(_sum) / _count);
+    it = format_to(it, "\"p50\":{},\"p90\":{},\"p99\":{},\"p999\":{},",
+        percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999));
+    // non-empty buckets, as [lowest, highest, count]
+    it = format_to(it, "\"buckets\":[");
+    bool first = true;
+    for(size_t i = 0; i < _counts.size(); ++i) {
+        if (_counts[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            it = format_to(it, ",");
+        }
+        first = false;
+        it = format_to(it, "[{},{},{}]", lowest_of(i), highest_of(i), _counts[i]);
+    }
+    it = format_to(it, "]");
+    return json;
+}
+
+void check_latency(const char* caseName, const LatencyHistogram& hist, const LatencyBounds& bounds)
+{
+    emit_record("latency", ::std::string("{\"name\":\"") + caseName + "\"," + hist.to_json() + "}");
+
+    struct {
+        const char* name;
+        double q;
+        uint64_t bound;
+    } checks[] = {
+        {"p50", 0.5, bounds.p50},
+        {"p90", 0.9, bounds.p90},
+        {"p99", 0.99, bounds.p99},
+        {"p99.9", 0.999, bounds.p999},
+        {"max", 1.0, bounds.max},
+    };
+    for(const auto& c: checks) {
+        if (c.bound == 0) {
+            continue;
+        }
+        uint64_t lat = hist.percentile(c.q);
+        string msg;
+        format_to(back_inserter(msg), "{} latency {} ns exceeds {} ns", c.name, lat, c.bound);
+        TESTA_ASSERT(lat <= c.bound)
+            .hint("calls={}", hist.count())
+            .issue(msg);
+    }
+}
+
+namespace {
+
+constexpr double kScalingWarmup = 0.05;
+constexpr double kScalingTime = 0.2;
+
+// Runs `worker` by `n` threads for `secs` seconds,
+// and returns operations per second.
+double run_threads(
+    const function<uint64_t(size_t, const atomic<bool>&)>& worker,
+    size_t n,
+    double secs)
+{
+    atomic<size_t> ready(0);
+    atomic<bool> go(false);
+    atomic<bool> stop(false);
+    vector<uint64_t> ops(n, 0);
+    vector<thread> threads;
+    for(size_t i = 0; i < n; ++i) {
+        threads.emplace_back([&, i]() {
+            ready.fetch_add(1);
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            ops[i] = worker(i, stop);
+        });
+    }
+    while (ready.load() < n) {
+        this_thread::yield();
+    }
+    auto start = chrono::steady_clock::now();
+    go.store(true);
+    this_thread::sleep_for(chrono::duration<double>(secs));
+    stop.store(true);
+    for(auto& t: threads) {
+        t.join();
+    }
+    chrono::duration<double> dur = chrono::steady_clock::now() - start;
+    uint64_t total = 0;
+    for(uint64_t x: ops) {
+        total += x;
+    }
+    return total / dur.count();
+}
+
+}
+
+void run_scaling(
+    const char* caseName,
+    const function<uint64_t(size_t, const atomic<bool>&)>& worker,
+    size_t maxThreads,
+    double minEfficiency)
+{
+    size_t cores = pool_threads();
+    if (maxThreads == 0 || maxThreads > cores) {
+        maxThreads = cores;
+    }
+    vector<size_t> points;
+    for(size_t n = 1; n < maxThreads; n *= 2) {
+        points.push_back(n);
+    }
+    points.push_back(maxThreads);
+
+    run_threads(worker, 1, kScalingWarmup);
+    vector<double> throughputs;
+    for(size_t n: points) {
+        throughputs.push_back(run_threads(worker, n, kScalingTime));
+    }
+
+    string json;
+    auto it = back_inserter(json);
+    it = format_to(it, "{{\"name\":\"{}\",\"min_efficiency\":{},\"points\":[",
+        caseName, minEfficiency);
+    vector<double> efficiencies;
+    for(size_t i = 0; i < points.size(); ++i) {
+        double eff = throughputs[i] / (points[i] * throughputs[0]);
+        efficiencies.push_back(eff);
+        printf("%s: %zu threads, %.0f ops/sec, efficiency %.1f%%\n",
+            caseName, points[i], throughputs[i], eff * 100);
+        if (i > 0) {
+            it = format_to(it, ",");
+        }
+        it = format_to(it, "{{\"threads\":{},\"ops_per_sec\":{:.1f},\"efficiency\":{:.4f}}}",
+            points[i], throughputs[i], eff);
+    }
+    it = format_to(it, "]}}");
+    emit_record("scaling", json);
+
+    for(size_t i = 0; i < points.size(); ++i) {
+        string msg;
+        format_to(back_inserter(msg), "efficiency at {} threads is {:.1f}%, less than {:.1f}%",
+            points[i], efficiencies[i] * 100, minEfficiency * 100);
+        TESTA_ASSERT(efficiencies[i] >= minEfficiency)
+            .hint("ops/sec at 1 thread={:.0f}", throughputs[0])
+            .hint("ops/sec at {} threads={:.0f}", points[i], throughputs[i])
+            .issue(msg);
+    }
+}
+
+void require_alloc_counting()
+{
+    TESTA_ASSERT(alloc_counting())
+        .issue("allocations are not counted; build testa with TESTA_COUNT_ALLOCS");
+}
+
+namespace {
+
+constexpr char kGoldenMagic[8] = {'T', 'E', 'S', 'T', 'A', 'G', 'D', '1'};
+
+}
+
+GoldenFile::GoldenFile(const char* caseName, const char* oracleName)
+:   _oracle(case_hash(oracleName)),
+    _regenerate(getenv("TESTA_GOLDEN_REGENERATE") != nullptr),
+    _map(nullptr),
+    _mapSize(0),
+    _results(nullptr)
+{
+    const char* dir = getenv("TESTA_GOLDEN_DIR");
+    if (dir == nullptr || *dir == '\0') {
+        return;
+    }
+    _path = string(dir) + "/" + caseName + ".golden";
+    if (_regenerate) {
+        return;
+    }
+    int fd = open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(Header)) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            _map = static_cast<const char*>(p);
+            _mapSize = st.st_size;
+        }
+    }
+    close(fd);
+    if (_map == nullptr) {
+        return;
+    }
+    // A file of another oracle, or a broken one, is regarded as empty.
+    Header hdr;
+    memcpy(&hdr, _map, sizeof(hdr));
+    size_t room = (_mapSize - sizeof(Header)) / sizeof(Entry);
+    if (memcmp(hdr.magic, kGoldenMagic, sizeof(kGoldenMagic)) != 0
+        || hdr.oracle != _oracle
+        || hdr.entries > room)
+    {
+        return;
+    }
+    _entries = span<const Entry>(
+        reinterpret_cast<const Entry*>(_map + sizeof(Header)), hdr.entries);
+    _results = _map + sizeof(Header) + hdr.entries * sizeof(Entry);
+    size_t resultsSize = _map + _mapSize - _results;
+    for(const Entry& e: _entries) {
+        if (e.offset > resultsSize || e.size > resultsSize - e.offset) {
+            _entries = span<const Entry>();
+            return;
+        }
+    }
+}
+
+GoldenFile::~GoldenFile()
+{
+    if (_map != nullptr) {
+        munmap(const_cast<char*>(_map), _mapSize);
+    }
+}
+
+optional<string_view> GoldenFile::find(uint64_t key) const
+{
+    auto it = lower_bound(_entries.begin(), _entries.end(), key,
+        [](const Entry& e, uint64_t k) {
+            return e.key < k;
+        });
+    if (it != _entries.end() && it->key == key) {
+        return string_view(_results + it->offset, it->size);
+    }
+    auto added = _added.find(key);
+    if (added != _added.end()) {
+        return string_view(added->second);
+    }
+    return nullopt;
+}
+
+void GoldenFile::add(uint64_t key, string result)
+{
+    _added.emplace(key, std::move(result));
+}
+
+void GoldenFile::save()
+{
+    if (!enabled() || (_added.empty() && !_regenerate)) {
+        return;
+    }
+    // Merges two sorted lists of entries.
+    vector<pair<uint64_t, string_view>> results;
+    results.reserve(_entries.size() + _added.size());
+    auto it = _entries.begin();
+    for(const auto& [key, res]: _added) {
+        for(; it != _entries.end() && it->key < key; ++it) {
+            results.emplace_back(it->key, string_view(_results + it->offset, it->size));
+        }
+        results.emplace_back(key, res);
+    }
+    for(; it != _entries.end(); ++it) {
+        results.emplace_back(it->key, string_view(_results + it->offset, it->size));
+    }
+
+    Header hdr;
+    memcpy(hdr.magic, kGoldenMagic, sizeof(kGoldenMagic));
+    hdr.oracle = _oracle;
+    hdr.entries = results.size();
+    vector<Entry> entries;
+    entries.reserve(results.size());
+    uint64_t offset = 0;
+    for(const auto& [key, res]: results) {
+        entries.push_back(Entry{key, offset, res.size()});
+        offset += res.size();
+    }
+
+    // Written aside and then renamed, so a concurrent run never sees a partial file.
+    string tmp = _path + ".tmp." + std::to_string(getpid());
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    TESTA_ASSERT(fp != nullptr)
+        .hint("file={}", tmp)
+        .issue("cannot write golden file");
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+        && fwrite(entries.data(), sizeof(Entry), entries.size(), fp) == entries.size();
+    for(size_t i = 0; ok && i < results.size(); ++i) {
+        ok = fwrite(results[i].second.data(), 1, results[i].second.size(), fp) == results[i].second.size();
+    }
+    ok = (fclose(fp) == 0) && ok;
+    ok = ok && rename(tmp.c_str(), _path.c_str()) == 0;
+    if (!ok) {
+        remove(tmp.c_str());
+    }
+    TESTA_ASSERT(ok)
+        .hint("file={}", _path)
+        .issue("cannot write golden file");
+}
+
 }
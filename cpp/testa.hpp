@@ -1,12 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <deque>
+#include <exception>
 #include <functional>
 #include <map>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 
 #ifdef ENABLE_STD_FORMAT
 #include <format>
@@ -19,11 +33,419 @@
     if (cond) {\
     } else ::std::move(::testa::_impl::CaseFailIssuer(#cond, __FILE__, __LINE__))
 
+namespace testa {
+
+// Isolation levels of cases, as those defined in README.
+enum class Isolation {
+    Pure,
+    Unit,
+    Smoke,
+    Functional,
+};
+
+const char* to_string(Isolation iso);
+
+// Bounds of latencies in nanoseconds, or 0 for no bound.
+struct LatencyBounds {
+    ::std::uint64_t p50 = 0;
+    ::std::uint64_t p90 = 0;
+    ::std::uint64_t p99 = 0;
+    ::std::uint64_t p999 = 0;
+    ::std::uint64_t max = 0;
+};
+
+// Counters of heap allocations through operator new.
+// They are counted only if testa is built with TESTA_COUNT_ALLOCS,
+// and are all 0 otherwise.
+struct AllocCounters {
+    ::std::uint64_t allocs = 0;
+    ::std::uint64_t frees = 0;
+    // bytes allocated in total
+    ::std::uint64_t bytes = 0;
+    // bytes allocated but not yet freed
+    ::std::int64_t live = 0;
+    // the most of live bytes
+    ::std::int64_t peak = 0;
+};
+
+bool alloc_counting();
+
+// Counters of the whole process.
+AllocCounters process_allocs();
+
+// Counters of allocations and frees by the calling thread.
+AllocCounters thread_allocs();
+
+// Counts allocations by the calling thread since its construction.
+class AllocScope {
+public:
+    AllocScope();
+    ~AllocScope();
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+    // `peak` is relative to live bytes at the construction.
+    AllocCounters counters() const;
+
+    // The innermost scope alive in the calling thread, or nullptr if none.
+    static const AllocScope* innermost();
+
+private:
+    AllocCounters _start;
+    const AllocScope* _outer;
+};
+
+// Keeps `x` from being optimized away, as if it were read by someone unknown.
+template<class T>
+inline void do_not_optimize(const T& x)
+{
+    asm volatile("" : : "r,m"(x) : "memory");
+}
+
+// A corpus of inputs in a file, e.g., captured traces.
+// The file starts with 8 bytes "TESTACP1",
+// followed by records, each of which is a 4-byte little-endian length and then as many bytes.
+// It is memory-mapped, and records are viewed in place without copies.
+class Corpus {
+public:
+    // `path` is relative to the directory of the executable, unless it is absolute.
+    explicit Corpus(const ::std::string& path);
+    ~Corpus();
+
+    Corpus(const Corpus&) = delete;
+    Corpus& operator=(const Corpus&) = delete;
+
+    ::std::size_t size() const
+    {
+        return _records.size();
+    }
+
+    ::std::string_view operator[](::std::size_t idx) const
+    {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(_map + _records[idx]);
+        ::std::uint32_t len = p[0] | (p[1] << 8) | (p[2] << 16) | (::std::uint32_t(p[3]) << 24);
+        return ::std::string_view(reinterpret_cast<const char*>(p + 4), len);
+    }
+
+    // Advises the kernel to read records in [first, last) ahead.
+    void prefetch(::std::size_t first, ::std::size_t last) const;
+
+private:
+    const char* _map;
+    ::std::size_t _mapSize;
+    // offsets of records in the file
+    ::std::vector<::std::uint64_t> _records;
+};
+
+// Writes records into a corpus file, in the format Corpus describes.
+class CorpusWriter {
+public:
+    explicit CorpusWriter(const ::std::string& path);
+    ~CorpusWriter();
+
+    CorpusWriter(const CorpusWriter&) = delete;
+    CorpusWriter& operator=(const CorpusWriter&) = delete;
+
+    void add(::std::string_view record);
+
+    // Flushes records into the file. It is also done by the destructor, unless it is done.
+    void close();
+
+private:
+    ::std::string _path;
+    ::std::FILE* _fp;
+};
+
+template<class T, class Enable = void>
+struct FuzzDecode;
+
+// Reads inputs of fuzz cases from bytes generated by the fuzzer.
+// Once bytes run out, the rest reads as zeros.
+class FuzzReader {
+public:
+    explicit FuzzReader(::std::string_view bytes)
+    :   _bytes(bytes)
+    {}
+
+    // Up to `n` bytes, or fewer if the rest is shorter.
+    ::std::string_view take(::std::size_t n)
+    {
+        n = ::std::min(n, _bytes.size());
+        ::std::string_view res = _bytes.substr(0, n);
+        _bytes.remove_prefix(n);
+        return res;
+    }
+
+    template<class T>
+    T read()
+    {
+        return FuzzDecode<T>::decode(*this);
+    }
+
+private:
+    ::std::string_view _bytes;
+};
+
+// How a type is decoded by FuzzReader.
+// Specialize it for types of other inputs.
+//
+// Arithmetic values take as many bytes as their sizes.
+template<class T>
+struct FuzzDecode<T, ::std::enable_if_t<::std::is_arithmetic_v<T>>> {
+    static T decode(FuzzReader& reader)
+    {
+        unsigned char buf[sizeof(T)] = {};
+        ::std::string_view bytes = reader.take(sizeof(T));
+        ::std::memcpy(buf, bytes.data(), bytes.size());
+        if constexpr (::std::is_same_v<T, bool>) {
+            return buf[0] & 1;
+        } else {
+            T x;
+            ::std::memcpy(&x, buf, sizeof(T));
+            return x;
+        }
+    }
+};
+
+// Strings and vectors take a byte of length, and then as many bytes or elements.
+template<>
+struct FuzzDecode<::std::string> {
+    static ::std::string decode(FuzzReader& reader)
+    {
+        ::std::size_t n = reader.read<unsigned char>();
+        return ::std::string(reader.take(n));
+    }
+};
+
+template<class T>
+struct FuzzDecode<::std::vector<T>> {
+    static ::std::vector<T> decode(FuzzReader& reader)
+    {
+        ::std::size_t n = reader.read<unsigned char>();
+        ::std::vector<T> res;
+        res.reserve(n);
+        for(::std::size_t i = 0; i < n; ++i) {
+            res.push_back(reader.read<T>());
+        }
+        return res;
+    }
+};
+
+template<class... Ts>
+struct FuzzDecode<::std::tuple<Ts...>> {
+    static ::std::tuple<Ts...> decode(FuzzReader& reader)
+    {
+        // Elements of a braced list are evaluated from left to right.
+        return ::std::tuple<Ts...>{reader.read<Ts>()...};
+    }
+};
+
+}
+
 namespace testa::_impl {
 
-using CaseMap = ::std::map<::std::string, ::std::function<void()>>;
+// Descriptors of cases are constant-initialized
+// and collected by the linker into section `testa_cases`,
+// so defining cases costs nothing at start-up.
+struct CaseDesc {
+    const char* name;
+    ::std::uint64_t hash;
+    void (*run)();
+    ::testa::Isolation isolation;
+    int line;
+    const char* file;
+};
+
+// Data files or directories which a case depends on, declared by TESTA_DEPS.
+// `deps` is a json array of paths, relative to the directory of the executable.
+struct DepsDesc {
+    const char* name;
+    const char* deps;
+};
+
+// Writes the line of json describing a case, which TESTA_IMPL_DEF_CASE puts into section `testa_manifest`,
+// to `out`, which either counts or stores characters.
+// Strings are escaped as json_escape does, since __FILE__ may contain any character.
+template<class Out>
+constexpr void write_manifest(Out& out, const char* name, const char* iso, const char* file, int line)
+{
+    auto raw = [&out](const char* s) {
+        for(; *s != '\0'; ++s) {
+            out.put(*s);
+        }
+    };
+    auto escaped = [&out, &raw](const char* s) {
+        constexpr char kHex[] = "0123456789abcdef";
+        for(; *s != '\0'; ++s) {
+            unsigned char c = *s;
+            if (c == '"' || c == '\\') {
+                out.put('\\');
+                out.put(c);
+            } else if (c == '\n') {
+                raw("\\n");
+            } else if (c == '\t') {
+                raw("\\t");
+            } else if (c < 0x20) {
+                raw("\\u00");
+                out.put(kHex[c >> 4]);
+                out.put(kHex[c & 0xf]);
+            } else {
+                out.put(c);
+            }
+        }
+    };
+    raw("{\"name\":\"");
+    escaped(name);
+    raw("\",\"isolation\":\"");
+    escaped(iso);
+    raw("\",\"file\":\"");
+    escaped(file);
+    raw("\",\"line\":");
+    char digits[16] = {};
+    int n = 0;
+    do {
+        digits[n++] = '0' + line % 10;
+        line /= 10;
+    } while (line > 0);
+    while (n > 0) {
+        out.put(digits[--n]);
+    }
+    raw("}\n");
+}
+
+consteval ::std::size_t manifest_size(const char* name, const char* iso, const char* file, int line)
+{
+    struct Counter {
+        ::std::size_t n = 0;
+        constexpr void put(char) { ++n; }
+    } out;
+    write_manifest(out, name, iso, file, line);
+    return out.n;
+}
+
+template<::std::size_t N>
+consteval ::std::array<char, N> manifest(const char* name, const char* iso, const char* file, int line)
+{
+    struct Filler {
+        ::std::array<char, N> res = {};
+        ::std::size_t n = 0;
+        constexpr void put(char c) { res[n++] = c; }
+    } out;
+    write_manifest(out, name, iso, file, line);
+    return out.res;
+}
+
+// FNV-1a
+constexpr ::std::uint64_t case_hash(::std::string_view name)
+{
+    ::std::uint64_t h = 14695981039346656037ull;
+    for(char c: name) {
+        h ^= (unsigned char) c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// All cases in this executable, in no particular order.
+::std::span<const CaseDesc> all_cases();
+
+// The case named `name`, or nullptr if there is no such case.
+const CaseDesc* find_case(::std::string_view name);
+
+// Dependencies of the case named `name`, or nullptr if none is declared.
+const DepsDesc* find_deps(::std::string_view name);
+
+// Inputs of a testbench are indexed from 0 by the order of being produced.
+// Only inputs in [first, last) are checked,
+// so that a failed input can be replayed, by `--input` or `--from` of the test executable,
+// without checking those before it.
+struct InputRange {
+    ::std::size_t first = 0;
+    ::std::size_t last = SIZE_MAX;
+};
+
+const InputRange& selected_inputs();
+void select_inputs(const InputRange& range);
+
+// Index of the input being checked by the calling thread, or SIZE_MAX if none.
+// CaseFailIssuer reports it along with failures.
+inline constinit thread_local ::std::size_t tInputIndex = SIZE_MAX;
+
+// Also counts allocations of the input,
+// so that CaseFailIssuer reports those of the failed input alone.
+class InputIndexScope {
+public:
+    explicit InputIndexScope(::std::size_t idx)
+    {
+        tInputIndex = idx;
+    }
+
+    ~InputIndexScope()
+    {
+        tInputIndex = SIZE_MAX;
+    }
+
+    InputIndexScope(const InputIndexScope&) = delete;
+    InputIndexScope& operator=(const InputIndexScope&) = delete;
+
+private:
+    ::testa::AllocScope _allocs;
+};
 
-::std::shared_ptr<CaseMap> get_case_map();
+// Index of the failed input being shrunk by the calling thread, or SIZE_MAX if none.
+// While shrinking, smaller variants of the input are fed by the testbench,
+// which are checked regardless of selection, and reported with the index of the input.
+inline constinit thread_local ::std::size_t tShrinkIndex = SIZE_MAX;
+
+class ShrinkScope {
+public:
+    explicit ShrinkScope(::std::size_t idx)
+    {
+        tShrinkIndex = idx;
+    }
+
+    ~ShrinkScope()
+    {
+        tShrinkIndex = SIZE_MAX;
+    }
+
+    ShrinkScope(const ShrinkScope&) = delete;
+    ShrinkScope& operator=(const ShrinkScope&) = delete;
+};
+
+// Thrown through a testbench to stop it after the last selected input.
+struct InputsDone {};
+
+// Runs a testbench on a check, skipping inputs not selected.
+template<class Testbench, class Check>
+void run_tb(const char* caseName, const Testbench& tb, const Check& check)
+{
+    const InputRange range = selected_inputs();
+    ::std::size_t next = 0;
+    auto cs = [&](const auto&... in) {
+        if (tShrinkIndex != SIZE_MAX) {
+            InputIndexScope scope(tShrinkIndex);
+            check(in...);
+            return;
+        }
+        ::std::size_t idx = next++;
+        if (idx < range.first) {
+            return;
+        }
+        {
+            InputIndexScope scope(idx);
+            check(in...);
+        }
+        if (next >= range.last) {
+            throw InputsDone();
+        }
+    };
+    try {
+        ::std::invoke(tb, ::std::string(caseName), cs);
+    } catch (const InputsDone&) {
+    }
+}
 
 class CaseFailIssuer {
 public:
@@ -32,8 +454,10 @@ public:
 
     CaseFailIssuer(const CaseFailIssuer&) = delete;
     CaseFailIssuer& operator=(const CaseFailIssuer&) = delete;
-    CaseFailIssuer(CaseFailIssuer&&) = default;
-    CaseFailIssuer& operator=(CaseFailIssuer&&) = default;
+    // A moved-from issuer is regarded as issued,
+    // so only the last one checks whether issue() is invoked.
+    CaseFailIssuer(CaseFailIssuer&&);
+    CaseFailIssuer& operator=(CaseFailIssuer&&);
 
     template<class... Args>
     requires (sizeof...(Args) > 0)
@@ -59,146 +483,1262 @@ private:
     bool _issued;
 };
 
-class EqCase {
+// How many threads a pool runs:
+// environment variable TESTA_THREADS, or as many as cpu cores if it is absent.
+::std::size_t pool_threads();
+
+// Whether pools created by the calling thread run chunks inline, rather than by threads of their own.
+// Workers of --run-pure set it, since they are already as many as pool_threads().
+inline constinit thread_local bool tInlinePools = false;
+
+// Runs chunks of testbench inputs by a pool of threads, as many as pool_threads(),
+// or inline by the calling thread if tInlinePools is set.
+// Inputs are indexed by the order of being produced.
+// Among failed inputs, the one with the lowest index wins,
+// so the failure reported is the same as that of a serial run.
+class ChunkPool {
 public:
-    template<class Res, class T>
-    EqCase(
-        const ::std::string& caseName,
-        void (*tb)(const ::std::string&, ::std::function<void(const T&)>),
-        Res (*trialFn)(const T&),
-        Res (*oracleFn)(const T&)
-    ) {
-        ::std::function<void(T)> cs = ::std::bind(
-            &EqCase::eq<Res, T>,
-            trialFn,
-            oracleFn,
-            ::std::placeholders::_1);
-        (*testa::_impl::get_case_map())[caseName] = ::std::bind(tb, caseName, cs);
-    }
-
-    template<class Res, class T>
-    EqCase(
-        const std::string& caseName,
-        Res (*trialFn)(const T&),
-        Res (*oracleFn)(const T&),
-        const T& in
-    ) {
-        ::std::function<void()> cs = ::std::bind(
-            &EqCase::eq<Res, T>,
-            trialFn,
-            oracleFn,
-            in);
-        (*testa::_impl::get_case_map())[caseName] = cs;
-    }
-
-    template<class Res, class T0, class T1>
-    EqCase(
-        const ::std::string& caseName,
-        Res (*trialFn)(const ::std::tuple<T0, T1>&),
-        Res (*oracleFn)(const ::std::tuple<T0, T1>&),
-        const T0& in0,
-        const T1& in1
-    ) {
-        ::std::function<void()> cs = ::std::bind(
-            &EqCase::eq<Res, ::std::tuple<T0, T1> >,
-            trialFn,
-            oracleFn,
-            ::std::make_tuple(in0, in1));
-        (*testa::_impl::get_case_map())[caseName] = cs;
-    }
-
-    template<class Res, class T0, class T1, class T2>
-    EqCase(
-        const ::std::string& caseName,
-        Res (*trialFn)(const ::std::tuple<T0, T1, T2>&),
-        Res (*oracleFn)(const ::std::tuple<T0, T1, T2>&),
-        const T0& in0,
-        const T1& in1,
-        const T2& in2
-    ) {
-        ::std::function<void()> cs = ::std::bind(
-            &EqCase::eq<Res, ::std::tuple<T0, T1, T2> >,
-            trialFn,
-            oracleFn,
-            ::std::make_tuple(in0, in1, in2));
-        (*testa::_impl::get_case_map())[caseName] = cs;
+    ChunkPool();
+    ~ChunkPool();
+
+    ChunkPool(const ChunkPool&) = delete;
+    ChunkPool& operator=(const ChunkPool&) = delete;
+
+    ::std::size_t threads() const;
+
+    // Blocks while too many chunks are pending.
+    void submit(::std::function<void()> chunk);
+
+    // Waits for all submitted chunks,
+    // and then rethrows the failure of the lowest index, if any.
+    void wait();
+
+    // Index of the earliest failed input so far, or SIZE_MAX if none fails.
+    ::std::size_t failed_index() const
+    {
+        return _failedIdx.load(::std::memory_order_relaxed);
     }
 
+    void fail(::std::size_t idx, ::std::exception_ptr ex);
+
 private:
-    template<class Res, class T>
-    static void eq(
-        Res (*trialFn)(const T&),
-        Res (*oracleFn)(const T&),
-        const T& in
-    ) {
-        const Res& trialResult = trialFn(in);
-        const Res& oracleResult = oracleFn(in);
+    struct Impl;
+
+    ::std::atomic<::std::size_t> _failedIdx;
+    ::std::unique_ptr<Impl> _impl;
+};
+
+// Checks the input made by `make`, which is made inside the same `try`,
+// so a failure in making an input is reported as a failure of the input.
+template<class Make, class Fn>
+bool run_input(ChunkPool& pool, ::std::size_t idx, const Fn& fn, const Make& make)
+{
+    if (idx >= pool.failed_index()) {
+        return false;
+    }
+    try {
+        InputIndexScope scope(idx);
+        fn(make());
+        return true;
+    } catch (...) {
+        pool.fail(idx, ::std::current_exception());
+        return false;
+    }
+}
+
+template<class Arg>
+const Arg& inputs_of(const Arg& in)
+{
+    return in;
+}
+
+template<class... Args>
+requires (sizeof...(Args) != 1)
+::std::tuple<Args...> inputs_of(const Args&... in)
+{
+    return ::std::tuple<Args...>(in...);
+}
+
+// Runs a testbench producing inputs in a single thread,
+// while inputs are checked by a ChunkPool in chunks.
+template<class T, class Fn>
+void run_par_tb(
+    const ::std::string& caseName,
+    void (*tb)(const ::std::string&, ::std::function<void(const T&)>),
+    const Fn& fn
+) {
+    constexpr ::std::size_t kChunkSize = 1024;
+    const InputRange range = selected_inputs();
+    ChunkPool pool;
+    ::std::vector<T> chunk;
+    ::std::size_t next = 0;
+    auto flush = [&]() {
+        if (chunk.empty()) {
+            return;
+        }
+        ::std::size_t first = next - chunk.size();
+        pool.submit([&pool, &fn, first, xs = ::std::move(chunk)]() {
+            for(::std::size_t i = 0; i < xs.size(); ++i) {
+                if (!run_input(pool, first + i, fn, [&]() -> const T& { return xs[i]; })) {
+                    break;
+                }
+            }
+        });
+        chunk = ::std::vector<T>();
+        chunk.reserve(kChunkSize);
+    };
+    chunk.reserve(kChunkSize);
+    try {
+        tb(caseName, [&](const T& in) {
+            // no need to generate inputs beyond the first failure.
+            if (next >= pool.failed_index()) {
+                throw InputsDone();
+            }
+            if (next < range.first) {
+                ++next;
+                return;
+            }
+            chunk.push_back(in);
+            ++next;
+            if (chunk.size() == kChunkSize) {
+                flush();
+            }
+            if (next >= range.last) {
+                throw InputsDone();
+            }
+        });
+    } catch (const InputsDone&) {
+    }
+    flush();
+    pool.wait();
+}
+
+// Runs inputs `input(0)`, ..., `input(count - 1)` by a ChunkPool.
+template<class Input, class Fn>
+void run_indexed_tb(::std::size_t count, const Input& input, const Fn& fn)
+{
+    const InputRange range = selected_inputs();
+    count = ::std::min(count, range.last);
+    ChunkPool pool;
+    ::std::size_t step = count / (pool.threads() * 16);
+    step = ::std::max<::std::size_t>(1, ::std::min<::std::size_t>(step, 4096));
+    for(::std::size_t b = range.first; b < count && b < pool.failed_index(); b += step) {
+        ::std::size_t e = ::std::min(b + step, count);
+        pool.submit([&pool, &fn, &input, b, e]() {
+            for(::std::size_t i = b; i < e; ++i) {
+                if (!run_input(pool, i, fn, [&]() { return input(i); })) {
+                    break;
+                }
+            }
+        });
+    }
+    pool.wait();
+}
+
+// How fuzz cases run, set by `--fuzz` of the test executable.
+// Otherwise, they run a short and deterministic round of fuzzing.
+struct FuzzOptions {
+    bool enabled = false;
+    // how long to fuzz, or 0 for no limit
+    double seconds = 0;
+    // where inputs of new coverage and failed inputs are saved, and seeds are loaded from
+    ::std::string dir;
+};
+
+const FuzzOptions& fuzz_options();
+void select_fuzz(const FuzzOptions& opts);
+
+// Fuzzes `target` by inputs of bytes, guided by edge coverage,
+// until it throws, or runs out of time or runs.
+// A failed input is minimized, saved, and then run again to fail the case.
+void run_fuzz(const char* caseName, const ::std::function<void(::std::string_view)>& target);
+
+// Runs records of a corpus by a ChunkPool.
+// A chunk is of consecutive records in about kChunkBytes,
+// which are prefetched as it is submitted, so reading the file overlaps checking earlier chunks.
+template<class Fn>
+void run_corpus(const ::testa::Corpus& corpus, const Fn& fn)
+{
+    constexpr ::std::size_t kChunkBytes = 1 << 20;
+    constexpr ::std::size_t kChunkRecords = 4096;
+    const InputRange range = selected_inputs();
+    ::std::size_t count = ::std::min(corpus.size(), range.last);
+    ChunkPool pool;
+    for(::std::size_t b = range.first; b < count && b < pool.failed_index();) {
+        const char* start = corpus[b].data();
+        ::std::size_t e = b + 1;
+        while(e < count && e - b < kChunkRecords
+            && ::std::size_t(corpus[e].data() - start) < kChunkBytes)
+        {
+            ++e;
+        }
+        corpus.prefetch(b, e);
+        pool.submit([&pool, &fn, &corpus, b, e]() {
+            for(::std::size_t i = b; i < e; ++i) {
+                if (!run_input(pool, i, fn, [&]() { return corpus[i]; })) {
+                    break;
+                }
+            }
+        });
+        b = e;
+    }
+    pool.wait();
+}
+
+// Checks whether a trial agrees with an oracle on an input.
+// Inputs are passed by reference all the way down.
+// A testbench may feed several arguments at once, which are passed as they are.
+template<class Trial, class Oracle>
+struct EqCheck {
+    Trial trial;
+    Oracle oracle;
+
+    template<class... Args>
+    void operator()(const Args&... in) const
+    {
+        const auto& trialResult = ::std::invoke(trial, in...);
+        const auto& oracleResult = ::std::invoke(oracle, in...);
         TESTA_ASSERT(trialResult == oracleResult)
-            .hint("input={}", in)
+            .hint("input={}", inputs_of(in...))
             .hint("trial result={}", trialResult)
             .hint("oracle result={}", oracleResult)
             .issue();
     }
 };
 
+// Checks results of a trial by a verifier.
+template<class Verifier, class Trial>
+struct VerifyCheck {
+    Verifier verifier;
+    Trial trial;
+
+    template<class... Args>
+    void operator()(const Args&... in) const
+    {
+        const auto& res = ::std::invoke(trial, in...);
+        ::std::invoke(verifier, res, in...);
+    }
+};
+
+// Feeds fixed inputs to a check.
+// A single input is fed as it is.
+// Several inputs are fed as separated arguments if the trial accepts them,
+// or as a tuple otherwise.
+template<class Check, class Callee, class... Ins>
+void feed_inputs(const Check& check, const Callee& callee, const ::std::tuple<Ins...>& ins)
+{
+    if constexpr (sizeof...(Ins) == 1) {
+        check(::std::get<0>(ins));
+    } else if constexpr (::std::is_invocable_v<const Callee&, const Ins&...>) {
+        ::std::apply(check, ins);
+    } else {
+        check(ins);
+    }
+}
+
+// Columns of a batch of inputs of type T: one per element if T is a tuple,
+// or a single one otherwise.
+template<class T>
+struct ColumnsOf {
+    using type = ::std::tuple<T>;
+    using arrays = ::std::tuple<::std::unique_ptr<T[]>>;
+
+    static ::std::tuple<const T&> split(const T& in)
+    {
+        return ::std::tuple<const T&>(in);
+    }
+
+    static const T& join(const T& x)
+    {
+        return x;
+    }
+};
+
+template<class... Ts>
+struct ColumnsOf<::std::tuple<Ts...>> {
+    using type = ::std::tuple<Ts...>;
+    using arrays = ::std::tuple<::std::unique_ptr<Ts[]>...>;
+
+    static const ::std::tuple<Ts...>& split(const ::std::tuple<Ts...>& in)
+    {
+        return in;
+    }
+
+    static ::std::tuple<Ts...> join(const Ts&... xs)
+    {
+        return ::std::tuple<Ts...>(xs...);
+    }
+};
+
+// Gathers inputs of type T into batches in columns,
+// so batched trials and oracles take a contiguous array per argument, e.g.,
+//   void add(std::span<const int> a, std::span<const int> b, std::span<int> out);
+// and then compares their results element by element.
+// A mismatch is reported with the input, and its index, of the first mismatched element.
+template<class T, class Result, class Trial, class Oracle>
+class EqBatch {
+public:
+    static constexpr ::std::size_t kBatchSize = 1024;
+
+    EqBatch(const Trial& trial, const Oracle& oracle)
+    :   _trial(trial),
+        _oracle(oracle),
+        _indices(::std::make_unique<::std::size_t[]>(kBatchSize)),
+        _trialResults(::std::make_unique<Result[]>(kBatchSize)),
+        _oracleResults(::std::make_unique<Result[]>(kBatchSize))
+    {
+        [&]<::std::size_t... Is>(::std::index_sequence<Is...>) {
+            ((::std::get<Is>(_columns) = ::std::make_unique<::std::tuple_element_t<Is, Columns>[]>(
+                kBatchSize)), ...);
+        }(kColumnIndices);
+    }
+
+    EqBatch(const EqBatch&) = delete;
+    EqBatch& operator=(const EqBatch&) = delete;
+
+    // While shrinking, an input is checked at once, for the testbench to see whether it fails.
+    void push(const T& in)
+    {
+        auto&& xs = ColumnsOf<T>::split(in);
+        [&]<::std::size_t... Is>(::std::index_sequence<Is...>) {
+            ((::std::get<Is>(_columns)[_size] = ::std::get<Is>(xs)), ...);
+        }(kColumnIndices);
+        _indices[_size] = tInputIndex;
+        ++_size;
+        if (_size == kBatchSize || tShrinkIndex != SIZE_MAX) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        ::std::size_t n = _size;
+        if (n == 0) {
+            return;
+        }
+        _size = 0;
+        [&]<::std::size_t... Is>(::std::index_sequence<Is...>) {
+            ::std::invoke(_trial, column<Is>(n)..., ::std::span<Result>(_trialResults.get(), n));
+            ::std::invoke(_oracle, column<Is>(n)..., ::std::span<Result>(_oracleResults.get(), n));
+        }(kColumnIndices);
+        ::std::size_t first = n;
+        ::std::size_t mismatches = 0;
+        for(::std::size_t i = 0; i < n; ++i) {
+            if (!(_trialResults[i] == _oracleResults[i]) && mismatches++ == 0) {
+                first = i;
+            }
+        }
+        if (mismatches == 0) {
+            return;
+        }
+        InputIndexScope scope(_indices[first]);
+        const T in = [&]<::std::size_t... Is>(::std::index_sequence<Is...>) {
+            return ColumnsOf<T>::join(::std::get<Is>(_columns)[first]...);
+        }(kColumnIndices);
+        TESTA_ASSERT(_trialResults[first] == _oracleResults[first])
+            .hint("input={}", in)
+            .hint("trial result={}", _trialResults[first])
+            .hint("oracle result={}", _oracleResults[first])
+            .hint("mismatched elements={} of a batch of {}", mismatches, n)
+            .issue();
+    }
+
+private:
+    using Columns = typename ColumnsOf<T>::type;
+
+    static constexpr auto kColumnIndices = ::std::make_index_sequence<::std::tuple_size_v<Columns>>();
+
+    template<::std::size_t I>
+    ::std::span<const ::std::tuple_element_t<I, Columns>> column(::std::size_t n) const
+    {
+        return {::std::get<I>(_columns).get(), n};
+    }
+
+    Trial _trial;
+    Oracle _oracle;
+    typename ColumnsOf<T>::arrays _columns;
+    ::std::unique_ptr<::std::size_t[]> _indices;
+    ::std::unique_ptr<Result[]> _trialResults;
+    ::std::unique_ptr<Result[]> _oracleResults;
+    ::std::size_t _size = 0;
+};
+
+// Collects inputs per class, and then times trials and oracles over all inputs of each class.
+// Each side runs passes over the inputs until a sample takes a while,
+// so even a trial of a few instructions is measured by its own cost rather than clock noise.
+class SpeedupMeter {
+public:
+    explicit SpeedupMeter(double speedup);
+
+    // Runs one side on all inputs of a class once.
+    using Pass = ::std::function<void()>;
+
+    template<class Tuple, class Trial, class Oracle>
+    void add(::std::string cls, Tuple in, const Trial& trial, const Oracle& oracle)
+    {
+        Class& c = _classes[::std::move(cls)];
+        if (c.inputs == nullptr) {
+            auto ins = ::std::make_shared<::std::vector<Tuple>>();
+            c.inputs = ins;
+            c.trial = [ins, trial]() {
+                for(const Tuple& x: *ins) {
+                    ::testa::do_not_optimize(::std::apply(trial, x));
+                }
+            };
+            c.oracle = [ins, oracle]() {
+                for(const Tuple& x: *ins) {
+                    ::testa::do_not_optimize(::std::apply(oracle, x));
+                }
+            };
+        }
+        static_cast<::std::vector<Tuple>*>(c.inputs.get())->push_back(::std::move(in));
+        ++c.count;
+    }
+
+    // Times every class, emits a "speedup" record,
+    // and then fails if, in any class, trials are not `speedup` times as fast as oracles,
+    // or either side is too fast to be measured.
+    void check(const char* caseName) const;
+
+private:
+    struct Class {
+        ::std::size_t count = 0;
+        ::std::shared_ptr<void> inputs;
+        Pass trial;
+        Pass oracle;
+    };
+
+    double _speedup;
+    ::std::map<::std::string, Class> _classes;
+};
+
+template<class T>
+::std::string class_name(const T& x)
+{
+    if constexpr (::std::is_convertible_v<const T&, ::std::string_view>) {
+        return ::std::string(::std::string_view(x));
+    } else {
+#ifdef ENABLE_STD_FORMAT
+        return ::std::format("{}", x);
+#endif
+#ifdef ENABLE_FMTLIB
+        return ::fmt::format("{}", x);
+#endif
+    }
+}
+
+// A histogram of latencies in nanoseconds, in the manner of HdrHistogram.
+// Values below 256 have buckets of their own.
+// Above that, each power of two is split into 128 linear buckets,
+// so a value is off by less than 1% from others in its bucket.
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(::std::uint64_t ns)
+    {
+        ++_counts[bucket_of(ns)];
+        ++_count;
+        _sum += ns;
+        _min = ::std::min(_min, ns);
+        _max = ::std::max(_max, ns);
+    }
+
+    ::std::uint64_t count() const
+    {
+        return _count;
+    }
+
+    // The least value that `q` of recorded values are not above,
+    // up to the precision of buckets.
+    ::std::uint64_t percentile(double q) const;
+
+    ::std::string to_json() const;
+
+private:
+    static constexpr int kSubBits = 7;
+    static constexpr ::std::size_t kBuckets = ((64 - kSubBits - 1) << kSubBits) + (2 << kSubBits);
+
+    static ::std::size_t bucket_of(::std::uint64_t v)
+    {
+        int e = ::std::max(0, int(::std::bit_width(v)) - kSubBits - 1);
+        return (::std::size_t(e) << kSubBits) + (v >> e);
+    }
+
+    static ::std::uint64_t lowest_of(::std::size_t idx);
+    static ::std::uint64_t highest_of(::std::size_t idx);
+
+    ::std::vector<::std::uint64_t> _counts;
+    ::std::uint64_t _count;
+    ::std::uint64_t _sum;
+    ::std::uint64_t _min;
+    ::std::uint64_t _max;
+};
+
+// Emits a histogram as a "latency" record,
+// and then fails if any bound is exceeded.
+void check_latency(
+    const char* caseName,
+    const LatencyHistogram& hist,
+    const ::testa::LatencyBounds& bounds);
+
+// A trial whose every call is timed into a histogram.
+template<class Trial>
+struct TimedTrial {
+    Trial trial;
+    LatencyHistogram* hist;
+
+    template<class... Args>
+    decltype(auto) operator()(const Args&... in) const
+    {
+        auto start = ::std::chrono::steady_clock::now();
+        decltype(auto) res = ::std::invoke(trial, in...);
+        ::testa::do_not_optimize(res);
+        auto dur = ::std::chrono::steady_clock::now() - start;
+        hist->record(::std::chrono::duration_cast<::std::chrono::nanoseconds>(dur).count());
+        return res;
+    }
+};
+
+// A trial whose allocations per call are bounded.
+// The trial is called once to warm up,
+// and then its allocations in the steady state are counted in a second call.
+template<class Trial>
+struct BudgetedTrial {
+    Trial trial;
+    ::std::uint64_t budget;
+
+    template<class... Args>
+    decltype(auto) operator()(const Args&... in) const
+    {
+        ::testa::do_not_optimize(::std::invoke(trial, in...));
+        ::testa::AllocCounters cnt;
+        {
+            ::testa::AllocScope scope;
+            ::testa::do_not_optimize(::std::invoke(trial, in...));
+            cnt = scope.counters();
+        }
+        TESTA_ASSERT(cnt.allocs <= budget)
+            .hint("input={}", inputs_of(in...))
+            .hint("allocations per call={}, budget={}", cnt.allocs, budget)
+            .hint("bytes per call={}, peak={}", cnt.bytes, cnt.peak)
+            .issue("trial allocates more than its budget");
+        return ::std::invoke(trial, in...);
+    }
+};
+
+void require_alloc_counting();
+
+// Oracle results persisted in file `DIR/CASENAME.golden`,
+// where DIR is taken from environment variable TESTA_GOLDEN_DIR.
+// Without it, nothing is persisted.
+// Results are keyed by hashes of inputs as formatted.
+// The file is memory-mapped and looked up in place,
+// and results added in a run are merged into it when the case passes.
+// If environment variable TESTA_GOLDEN_REGENERATE is set,
+// the file is ignored and rebuilt from results of this run.
+//
+// The file starts with a header, followed by entries sorted by keys,
+// followed by results which entries refer to.
+class GoldenFile {
+public:
+    struct Header {
+        char magic[8];
+        // hash of the name of the oracle
+        ::std::uint64_t oracle;
+        ::std::uint64_t entries;
+    };
+
+    struct Entry {
+        ::std::uint64_t key;
+        // relative to the start of results
+        ::std::uint64_t offset;
+        ::std::uint64_t size;
+    };
+
+    GoldenFile(const char* caseName, const char* oracleName);
+    ~GoldenFile();
+
+    GoldenFile(const GoldenFile&) = delete;
+    GoldenFile& operator=(const GoldenFile&) = delete;
+
+    bool enabled() const
+    {
+        return !_path.empty();
+    }
+
+    // The result of input `key` in bytes, if any.
+    ::std::optional<::std::string_view> find(::std::uint64_t key) const;
+
+    void add(::std::uint64_t key, ::std::string result);
+
+    void save();
+
+private:
+    ::std::string _path;
+    ::std::uint64_t _oracle;
+    bool _regenerate;
+    const char* _map;
+    ::std::size_t _mapSize;
+    ::std::span<const Entry> _entries;
+    const char* _results;
+    ::std::map<::std::uint64_t, ::std::string> _added;
+};
+
+// How oracle results are stored in golden files.
+// Trivially copyable results are stored byte by byte,
+// so they must not hold pointers.
+template<class T>
+struct GoldenCodec {
+    static constexpr bool supported = ::std::is_trivially_copyable_v<T>
+        && ::std::is_default_constructible_v<T>
+        && !::std::is_pointer_v<T>;
+
+    static ::std::string encode(const T& x)
+    {
+        return ::std::string(reinterpret_cast<const char*>(&x), sizeof(T));
+    }
+
+    static T decode(::std::string_view bytes)
+    {
+        T x;
+        ::std::memcpy(&x, bytes.data(), sizeof(T));
+        return x;
+    }
+};
+
+template<>
+struct GoldenCodec<::std::string> {
+    static constexpr bool supported = true;
+
+    static ::std::string encode(const ::std::string& x)
+    {
+        return x;
+    }
+
+    static ::std::string decode(::std::string_view bytes)
+    {
+        return ::std::string(bytes);
+    }
+};
+
+// An oracle whose results are looked up in a golden file,
+// and called only on inputs absent from it.
+template<class Oracle>
+struct GoldenOracle {
+    Oracle oracle;
+    GoldenFile* golden;
+
+    template<class... Args>
+    auto operator()(const Args&... in) const
+    {
+        using Res = ::std::decay_t<::std::invoke_result_t<const Oracle&, const Args&...>>;
+        static_assert(GoldenCodec<Res>::supported,
+            "results of golden oracles must be strings or trivially copyable without pointers");
+        if (!golden->enabled()) {
+            return Res(::std::invoke(oracle, in...));
+        }
+        ::std::uint64_t key = case_hash(class_name(inputs_of(in...)));
+        auto bytes = golden->find(key);
+        if (bytes) {
+            return GoldenCodec<Res>::decode(*bytes);
+        }
+        Res res = ::std::invoke(oracle, in...);
+        golden->add(key, GoldenCodec<Res>::encode(res));
+        return res;
+    }
+};
+
+// Checks a trial against an oracle as EqCheck does,
+// and then keeps the input for SpeedupMeter to time both of them in batches.
+template<class Trial, class Oracle, class Classify>
+struct SpeedupCheck {
+    EqCheck<Trial, Oracle> eq;
+    Classify classify;
+    SpeedupMeter* meter;
+
+    template<class... Args>
+    void operator()(const Args&... in) const
+    {
+        eq(in...);
+        meter->add(class_name(::std::invoke(classify, in...)),
+            ::std::tuple<::std::decay_t<Args>...>(in...), eq.trial, eq.oracle);
+    }
+};
+
+// Bodies of cases checking trial functions against oracles.
+class EqCase {
+public:
+    template<class Testbench, class Trial, class Oracle>
+    static void with_tb(
+        const char* caseName,
+        const Testbench& tb,
+        const Trial& trialFn,
+        const Oracle& oracleFn
+    ) {
+        EqCheck<Trial, Oracle> cs{trialFn, oracleFn};
+        run_tb(caseName, tb, cs);
+    }
+
+    template<class Trial, class Oracle, class... Ins>
+    static void with_inputs(
+        const Trial& trialFn,
+        const Oracle& oracleFn,
+        const ::std::tuple<Ins...>& ins
+    ) {
+        EqCheck<Trial, Oracle> cs{trialFn, oracleFn};
+        feed_inputs(cs, trialFn, ins);
+    }
+
+    template<class T, class Trial, class Oracle>
+    static void with_par_tb(
+        const char* caseName,
+        void (*tb)(const ::std::string&, ::std::function<void(const T&)>),
+        const Trial& trialFn,
+        const Oracle& oracleFn
+    ) {
+        EqCheck<Trial, Oracle> cs{trialFn, oracleFn};
+        run_par_tb(::std::string(caseName), tb, cs);
+    }
+
+    template<class Input, class Trial, class Oracle>
+    static void with_indexed_tb(
+        ::std::size_t count,
+        const Input& input,
+        const Trial& trialFn,
+        const Oracle& oracleFn
+    ) {
+        EqCheck<Trial, Oracle> cs{trialFn, oracleFn};
+        run_indexed_tb(count, input, cs);
+    }
+
+    template<class Trial, class Oracle>
+    static void with_corpus(
+        const char* path,
+        const Trial& trialFn,
+        const Oracle& oracleFn
+    ) {
+        ::testa::Corpus corpus(path);
+        EqCheck<Trial, Oracle> cs{trialFn, oracleFn};
+        run_corpus(corpus, cs);
+    }
+
+    template<class Result, class T, class Trial, class Oracle>
+    static void with_batch_tb(
+        const char* caseName,
+        void (*tb)(const ::std::string&, ::std::function<void(const T&)>),
+        const Trial& trialFn,
+        const Oracle& oracleFn
+    ) {
+        EqBatch<T, Result, Trial, Oracle> batch(trialFn, oracleFn);
+        run_tb(caseName, tb, [&batch](const T& in) {
+            batch.push(in);
+        });
+        batch.flush();
+    }
+
+    template<class Testbench, class Trial, class Oracle, class Classify>
+    static void with_tb_faster(
+        const char* caseName,
+        const Testbench& tb,
+        const Trial& trialFn,
+        const Oracle& oracleFn,
+        double speedup,
+        const Classify& classify
+    ) {
+        SpeedupMeter meter(speedup);
+        SpeedupCheck<Trial, Oracle, Classify> cs{{trialFn, oracleFn}, classify, &meter};
+        run_tb(caseName, tb, cs);
+        meter.check(caseName);
+    }
+
+    template<class Testbench, class Trial, class Oracle>
+    static void with_tb_latency(
+        const char* caseName,
+        const Testbench& tb,
+        const Trial& trialFn,
+        const Oracle& oracleFn,
+        const ::testa::LatencyBounds& bounds
+    ) {
+        LatencyHistogram hist;
+        EqCheck<TimedTrial<Trial>, Oracle> cs{{trialFn, &hist}, oracleFn};
+        run_tb(caseName, tb, cs);
+        check_latency(caseName, hist, bounds);
+    }
+
+    template<class Testbench, class Trial, class Oracle>
+    static void with_tb_alloc_budget(
+        const char* caseName,
+        const Testbench& tb,
+        const Trial& trialFn,
+        const Oracle& oracleFn,
+        ::std::uint64_t budget
+    ) {
+        require_alloc_counting();
+        EqCheck<BudgetedTrial<Trial>, Oracle> cs{{trialFn, budget}, oracleFn};
+        run_tb(caseName, tb, cs);
+    }
+
+    template<class Testbench, class Trial, class Oracle>
+    static void with_tb_golden(
+        const char* caseName,
+        const char* oracleName,
+        const Testbench& tb,
+        const Trial& trialFn,
+        const Oracle& oracleFn
+    ) {
+        GoldenFile golden(caseName, oracleName);
+        EqCheck<Trial, GoldenOracle<Oracle>> cs{trialFn, {oracleFn, &golden}};
+        run_tb(caseName, tb, cs);
+        golden.save();
+    }
+};
+
+// Bodies of differential fuzz cases, whose inputs are decoded by FuzzReader.
+class FuzzCase {
+public:
+    template<class... Ins, class Trial, class Oracle>
+    static void run(const char* caseName, const Trial& trialFn, const Oracle& oracleFn)
+    {
+        EqCheck<Trial, Oracle> cs{trialFn, oracleFn};
+        run_fuzz(caseName, [&](::std::string_view bytes) {
+            ::testa::FuzzReader reader(bytes);
+            feed_inputs(cs, trialFn, reader.read<::std::tuple<Ins...>>());
+        });
+    }
+};
+
+// Bodies of cases checking results of trial functions by verifiers.
 class VerifyCase {
 public:
-    template<class Res, class T>
-    VerifyCase(
-        const ::std::string& caseName,
+    template<class Testbench, class Verifier, class Trial>
+    static void with_tb(
+        const char* caseName,
+        const Testbench& tb,
+        const Verifier& verifier,
+        const Trial& trialFn
+    ) {
+        VerifyCheck<Verifier, Trial> cs{verifier, trialFn};
+        run_tb(caseName, tb, cs);
+    }
+
+    template<class T, class Verifier, class Trial>
+    static void with_par_tb(
+        const char* caseName,
         void (*tb)(const ::std::string&, ::std::function<void(const T&)>),
-        void (*verifier)(const Res&, const T&),
-        Res (*trialFn)(const T&)
+        const Verifier& verifier,
+        const Trial& trialFn
     ) {
-        ::std::function<void(T)> cs = ::std::bind(
-            &VerifyCase::verify<Res, T>,
-            verifier,
-            trialFn,
-            ::std::placeholders::_1);
-        (*testa::_impl::get_case_map())[caseName] = ::std::bind(tb, caseName, cs);
+        VerifyCheck<Verifier, Trial> cs{verifier, trialFn};
+        run_par_tb(::std::string(caseName), tb, cs);
     }
 
-    VerifyCase(
-        const ::std::string& caseName,
-        void (*tbVerifier)(const std::string&)
+    template<class Input, class Verifier, class Trial>
+    static void with_indexed_tb(
+        ::std::size_t count,
+        const Input& input,
+        const Verifier& verifier,
+        const Trial& trialFn
     ) {
-        (*testa::_impl::get_case_map())[caseName] = ::std::bind(tbVerifier, caseName);
+        VerifyCheck<Verifier, Trial> cs{verifier, trialFn};
+        run_indexed_tb(count, input, cs);
     }
 
-private:
-    template<class Res, class T>
-    static void verify(
-        void (*verifier)(const Res&, const T&),
-        Res (*trialFn)(const T&),
-        const T& in
+    template<class Verifier, class Trial>
+    static void with_corpus(
+        const char* path,
+        const Verifier& verifier,
+        const Trial& trialFn
     ) {
-        const Res& res = trialFn(in);
-        verifier(res, in);
+        ::testa::Corpus corpus(path);
+        VerifyCheck<Verifier, Trial> cs{verifier, trialFn};
+        run_corpus(corpus, cs);
+    }
+
+    template<class Testbench, class Verifier, class Trial>
+    static void with_tb_latency(
+        const char* caseName,
+        const Testbench& tb,
+        const Verifier& verifier,
+        const Trial& trialFn,
+        const ::testa::LatencyBounds& bounds
+    ) {
+        LatencyHistogram hist;
+        VerifyCheck<Verifier, TimedTrial<Trial>> cs{verifier, {trialFn, &hist}};
+        run_tb(caseName, tb, cs);
+        check_latency(caseName, hist, bounds);
+    }
+
+    template<class Testbench, class Verifier, class Trial>
+    static void with_tb_alloc_budget(
+        const char* caseName,
+        const Testbench& tb,
+        const Verifier& verifier,
+        const Trial& trialFn,
+        ::std::uint64_t budget
+    ) {
+        require_alloc_counting();
+        VerifyCheck<Verifier, BudgetedTrial<Trial>> cs{verifier, {trialFn, budget}};
+        run_tb(caseName, tb, cs);
+    }
+};
+
+::std::string json_escape(::std::string_view s);
+
+// Writes a structured record, a line of "##testa:KIND JSON", to stdout.
+// runtests.py collects records into its report.
+void emit_record(::std::string_view kind, const ::std::string& json);
+
+// If not null, records of this thread are appended here instead of stdout,
+// so that --run-pure replies records of each case along with its result.
+inline constinit thread_local ::std::string* tRecordSink = nullptr;
+
+// Measures a loop, which runs an operation `iters` times and returns seconds elapsed.
+// The loop is warmed up, and the number of iterations is calibrated
+// so that each sample takes a while.
+// Median, MAD and min of nanoseconds per operation over samples are
+// printed and emitted as a "bench" record.
+void run_bench(const char* caseName, const ::std::function<double(::std::uint64_t)>& loop);
+
+// Runs `worker` concurrently on 1, 2, 4, ... threads, up to `maxThreads`,
+// or as many as cpu cores (or TESTA_THREADS) if it is 0 or more than that.
+// `worker` takes the index of its thread and a stop flag,
+// and returns how many operations it has done until stopped.
+// Throughput and parallel efficiency at each point are printed
+// and emitted as a "scaling" record.
+// Fails if efficiency at any point is below `minEfficiency`.
+void run_scaling(
+    const char* caseName,
+    const ::std::function<::std::uint64_t(::std::size_t, const ::std::atomic<bool>&)>& worker,
+    ::std::size_t maxThreads,
+    double minEfficiency);
+
+// Bodies of thread-scaling cases.
+class ScalingCase {
+public:
+    template<class Fn>
+    static void run(const char* caseName, const Fn& fn, ::std::size_t maxThreads, double minEfficiency)
+    {
+        auto worker = [&fn](::std::size_t tid, const ::std::atomic<bool>& stop) {
+            ::std::uint64_t ops = 0;
+            while (!stop.load(::std::memory_order_relaxed)) {
+                if constexpr (::std::is_void_v<::std::invoke_result_t<const Fn&, ::std::size_t>>) {
+                    ::std::invoke(fn, tid);
+                } else {
+                    ::testa::do_not_optimize(::std::invoke(fn, tid));
+                }
+                ++ops;
+            }
+            return ops;
+        };
+        run_scaling(caseName, worker, maxThreads, minEfficiency);
+    }
+};
+
+// Bodies of micro-benchmark cases.
+class BenchCase {
+public:
+    template<class Fn>
+    static void run(const char* caseName, const Fn& fn)
+    {
+        run_bench(caseName, [&fn](::std::uint64_t iters) {
+            auto start = ::std::chrono::steady_clock::now();
+            for(::std::uint64_t i = 0; i < iters; ++i) {
+                if constexpr (::std::is_void_v<::std::invoke_result_t<const Fn&>>) {
+                    ::std::invoke(fn);
+                    // so that the call is not optimized away.
+                    asm volatile("" ::: "memory");
+                } else {
+                    ::testa::do_not_optimize(::std::invoke(fn));
+                }
+            }
+            ::std::chrono::duration<double> dur = ::std::chrono::steady_clock::now() - start;
+            return dur.count();
+        });
     }
 };
 
 }
 
+// Wraps a function, or any callable expression, into a stateless lambda,
+// so that calls to it are bound statically and can be inlined.
+#define TESTA_IMPL_FN(fn) \
+    [](const auto&... xs) -> decltype((fn)(xs...)) { return (fn)(xs...); }
+
+#define TESTA_IMPL_ISO_NAME_Pure "pure"
+#define TESTA_IMPL_ISO_NAME_Unit "unit"
+#define TESTA_IMPL_ISO_NAME_Smoke "smoke"
+#define TESTA_IMPL_ISO_NAME_Functional "functional"
+
+// Defines case `caseName`, whose body is the rest arguments.
+// `cs##caseName` has external linkage,
+// so duplicated case names are rejected by the linker.
+// Its alignment is pinned, otherwise compilers may over-align large objects
+// and leave holes in section `testa_cases`.
+//
+// Besides, a line of json describing the case is put into section `testa_manifest`,
+// so runtests.py can list cases by reading the executable rather than running it.
+#define TESTA_IMPL_DEF_CASE(caseName, iso, ...) \
+    static void testa_case_##caseName() \
+    { \
+        __VA_ARGS__; \
+    } \
+    __attribute__((used, retain, section("testa_manifest"), aligned(1))) \
+    static constexpr auto testa_manifest_##caseName = ::testa::_impl::manifest< \
+        ::testa::_impl::manifest_size(#caseName, TESTA_IMPL_ISO_NAME_##iso, __FILE__, __LINE__)>( \
+        #caseName, TESTA_IMPL_ISO_NAME_##iso, __FILE__, __LINE__); \
+    __attribute__((used, retain, section("testa_cases"), \
+        aligned(alignof(::testa::_impl::CaseDesc)))) \
+    constinit ::testa::_impl::CaseDesc cs##caseName = { \
+        #caseName, \
+        ::testa::_impl::case_hash(#caseName), \
+        &testa_case_##caseName, \
+        ::testa::Isolation::iso, \
+        __LINE__, \
+        __FILE__, \
+    }
+
+// Declares data files or directories, which case `caseName` reads, e.g.,
+// `TESTA_DEPS(CorrectGcd, "data/gcd.txt")`.
+// Paths are relative to the directory of the executable.
+// runtests.py re-runs a passed case only when the executable or any of them changes.
+#define TESTA_DEPS(caseName, ...) \
+    __attribute__((used, retain, section("testa_manifest"), aligned(1))) \
+    static const char testa_deps_##caseName[] = \
+        "{\"name\":\"" #caseName "\",\"deps\":[" #__VA_ARGS__ "]}\n"; \
+    __attribute__((used, retain, section("testa_deps"), \
+        aligned(alignof(::testa::_impl::DepsDesc)))) \
+    constinit ::testa::_impl::DepsDesc deps##caseName = { \
+        #caseName, \
+        "[" #__VA_ARGS__ "]", \
+    }
+
+// Each TESTA_DEF_XXX_ISO takes an isolation level,
+// one of Pure, Unit, Smoke and Functional, right after the case name.
+// TESTA_DEF_XXX is equivalent to TESTA_DEF_XXX_ISO with Unit.
+
+#define TESTA_DEF_EQ_WITH_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_tb( \
+        #caseName, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn)))
 
 #define TESTA_DEF_EQ_WITH_TB(caseName, caseTb, trialFn, oracleFn) \
-    testa::_impl::EqCase cs##caseName(#caseName, (caseTb), (trialFn), (oracleFn))
+    TESTA_DEF_EQ_WITH_TB_ISO(caseName, Unit, caseTb, trialFn, oracleFn)
+
+// Any number of fixed inputs.
+// Several inputs are passed to trialFn and oracleFn as separated arguments if they accept,
+// or as a tuple otherwise.
+#define TESTA_DEF_EQ_ISO(caseName, iso, trialFn, oracleFn, ...) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_inputs( \
+        TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn), ::std::make_tuple(__VA_ARGS__)))
+
+#define TESTA_DEF_EQ(caseName, trialFn, oracleFn, ...) \
+    TESTA_DEF_EQ_ISO(caseName, Unit, trialFn, oracleFn, __VA_ARGS__)
+
+#define TESTA_DEF_EQ_1_ISO(caseName, iso, trialFn, oracleFn, in0)        \
+    TESTA_DEF_EQ_ISO(caseName, iso, trialFn, oracleFn, (in0))
 
 #define TESTA_DEF_EQ_1(caseName, trialFn, oracleFn, in0)                 \
-    testa::_impl::EqCase cs##caseName(#caseName, (trialFn), (oracleFn), (in0))
+    TESTA_DEF_EQ_1_ISO(caseName, Unit, trialFn, oracleFn, in0)
+
+#define TESTA_DEF_EQ_2_ISO(caseName, iso, trialFn, oracleFn, in0, in1)   \
+    TESTA_DEF_EQ_ISO(caseName, iso, trialFn, oracleFn, (in0), (in1))
 
 #define TESTA_DEF_EQ_2(caseName, trialFn, oracleFn, in0, in1)        \
-    testa::_impl::EqCase cs##caseName(#caseName, (trialFn), (oracleFn), (in0), (in1))
+    TESTA_DEF_EQ_2_ISO(caseName, Unit, trialFn, oracleFn, in0, in1)
+
+#define TESTA_DEF_EQ_3_ISO(caseName, iso, trialFn, oracleFn, in0, in1, in2) \
+    TESTA_DEF_EQ_ISO(caseName, iso, trialFn, oracleFn, (in0), (in1), (in2))
 
 #define TESTA_DEF_EQ_3(caseName, trialFn, oracleFn, in0, in1, in2)       \
-    testa::_impl::EqCase cs##caseName(#caseName, (trialFn), (oracleFn), \
-        (in0), (in1), (in2))
+    TESTA_DEF_EQ_3_ISO(caseName, Unit, trialFn, oracleFn, in0, in1, in2)
+
+// Besides agreeing with oracleFn, trialFn must be `speedup` times as fast as oracleFn,
+// in total over all inputs of the testbench.
+// In TESTA_DEF_EQ_FASTER_BY_CLASS_WITH_TB, inputs are classified by `classifyFn`,
+// which takes the same arguments as trialFn and returns a string or anything formattable,
+// and trialFn must be `speedup` times as fast in every class.
+#define TESTA_DEF_EQ_FASTER_WITH_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn, speedup) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_tb_faster( \
+        #caseName, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn), (speedup), \
+        [](const auto&...) { return "all"; }))
+
+// Cases measuring time are functional by default, so runtests.py runs them alone.
+#define TESTA_DEF_EQ_FASTER_WITH_TB(caseName, caseTb, trialFn, oracleFn, speedup) \
+    TESTA_DEF_EQ_FASTER_WITH_TB_ISO(caseName, Functional, caseTb, trialFn, oracleFn, speedup)
+
+#define TESTA_DEF_EQ_FASTER_BY_CLASS_WITH_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn, speedup, classifyFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_tb_faster( \
+        #caseName, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn), (speedup), \
+        TESTA_IMPL_FN(classifyFn)))
+
+#define TESTA_DEF_EQ_FASTER_BY_CLASS_WITH_TB(caseName, caseTb, trialFn, oracleFn, speedup, classifyFn) \
+    TESTA_DEF_EQ_FASTER_BY_CLASS_WITH_TB_ISO(caseName, Functional, caseTb, trialFn, oracleFn, speedup, classifyFn)
+
+#define TESTA_DEF_VERIFY_WITH_TB_ISO(caseName, iso, caseTb, caseVerfier, trialFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::VerifyCase::with_tb( \
+        #caseName, (caseTb), TESTA_IMPL_FN(caseVerfier), TESTA_IMPL_FN(trialFn)))
 
 #define TESTA_DEF_VERIFY_WITH_TB(caseName, caseTb, caseVerfier, trialFn) \
-    testa::_impl::VerifyCase cs##caseName(#caseName, (caseTb), (caseVerfier), (trialFn))
+    TESTA_DEF_VERIFY_WITH_TB_ISO(caseName, Unit, caseTb, caseVerfier, trialFn)
+
+// Latency of every call to trialFn is recorded into a histogram,
+// which is written to stdout as a "latency" record.
+// The rest arguments initialize a ::testa::LatencyBounds, in nanoseconds,
+// e.g., `.p50 = 1000, .p999 = 100000`.
+#define TESTA_DEF_EQ_LATENCY_WITH_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn, ...) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_tb_latency( \
+        #caseName, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn), \
+        ::testa::LatencyBounds{__VA_ARGS__}))
+
+#define TESTA_DEF_EQ_LATENCY_WITH_TB(caseName, caseTb, trialFn, oracleFn, ...) \
+    TESTA_DEF_EQ_LATENCY_WITH_TB_ISO(caseName, Functional, caseTb, trialFn, oracleFn, __VA_ARGS__)
+
+#define TESTA_DEF_VERIFY_LATENCY_WITH_TB_ISO(caseName, iso, caseTb, caseVerfier, trialFn, ...) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::VerifyCase::with_tb_latency( \
+        #caseName, (caseTb), TESTA_IMPL_FN(caseVerfier), TESTA_IMPL_FN(trialFn), \
+        ::testa::LatencyBounds{__VA_ARGS__}))
+
+#define TESTA_DEF_VERIFY_LATENCY_WITH_TB(caseName, caseTb, caseVerfier, trialFn, ...) \
+    TESTA_DEF_VERIFY_LATENCY_WITH_TB_ISO(caseName, Functional, caseTb, caseVerfier, trialFn, __VA_ARGS__)
+
+// Besides correctness, trialFn may allocate no more than `maxAllocs` times per call
+// in the steady state, i.e., in the second call on the same input.
+// These cases fail unless testa is built with TESTA_COUNT_ALLOCS.
+#define TESTA_DEF_EQ_ALLOC_BUDGET_WITH_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn, maxAllocs) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_tb_alloc_budget( \
+        #caseName, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn), (maxAllocs)))
+
+#define TESTA_DEF_EQ_ALLOC_BUDGET_WITH_TB(caseName, caseTb, trialFn, oracleFn, maxAllocs) \
+    TESTA_DEF_EQ_ALLOC_BUDGET_WITH_TB_ISO(caseName, Unit, caseTb, trialFn, oracleFn, maxAllocs)
+
+#define TESTA_DEF_VERIFY_ALLOC_BUDGET_WITH_TB_ISO(caseName, iso, caseTb, caseVerfier, trialFn, maxAllocs) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::VerifyCase::with_tb_alloc_budget( \
+        #caseName, (caseTb), TESTA_IMPL_FN(caseVerfier), TESTA_IMPL_FN(trialFn), (maxAllocs)))
+
+#define TESTA_DEF_VERIFY_ALLOC_BUDGET_WITH_TB(caseName, caseTb, caseVerfier, trialFn, maxAllocs) \
+    TESTA_DEF_VERIFY_ALLOC_BUDGET_WITH_TB_ISO(caseName, Unit, caseTb, caseVerfier, trialFn, maxAllocs)
+
+// Results of oracleFn are persisted in a golden file, as GoldenFile describes,
+// so oracleFn runs only on inputs new to the file.
+// oracleFn is identified by its name,
+// so the file must be regenerated once oracleFn is changed.
+// Results must be strings, or trivially copyable without pointers.
+#define TESTA_DEF_EQ_GOLDEN_WITH_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_tb_golden( \
+        #caseName, #oracleFn, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn)))
+
+#define TESTA_DEF_EQ_GOLDEN_WITH_TB(caseName, caseTb, trialFn, oracleFn) \
+    TESTA_DEF_EQ_GOLDEN_WITH_TB_ISO(caseName, Unit, caseTb, trialFn, oracleFn)
+
+// Batched checks, for vectorized functions.
+// trialFn and oracleFn take a batch of inputs at once,
+// as a `std::span<const X>` per argument, and write results into a `std::span<resultType>`.
+// Inputs fed by caseTb are gathered into batches of up to 1024,
+// where a tuple input is split into a column per element.
+#define TESTA_DEF_EQ_BATCH_WITH_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn, resultType) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_batch_tb<resultType>( \
+        #caseName, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn)))
+
+#define TESTA_DEF_EQ_BATCH_WITH_TB(caseName, caseTb, trialFn, oracleFn, resultType) \
+    TESTA_DEF_EQ_BATCH_WITH_TB_ISO(caseName, Unit, caseTb, trialFn, oracleFn, resultType)
+
+// Parallel testbenches are opt-in.
+// A testbench of TESTA_DEF_XXX_WITH_PAR_TB is the same as that of TESTA_DEF_XXX_WITH_TB,
+// but inputs are copied into chunks and checked by all cores.
+// TESTA_DEF_XXX_WITH_INDEXED_TB takes, instead of a testbench,
+// the number of inputs and a function making the i-th input.
+
+#define TESTA_DEF_EQ_WITH_PAR_TB_ISO(caseName, iso, caseTb, trialFn, oracleFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_par_tb( \
+        #caseName, (caseTb), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn)))
+
+#define TESTA_DEF_EQ_WITH_PAR_TB(caseName, caseTb, trialFn, oracleFn) \
+    TESTA_DEF_EQ_WITH_PAR_TB_ISO(caseName, Unit, caseTb, trialFn, oracleFn)
+
+#define TESTA_DEF_EQ_WITH_INDEXED_TB_ISO(caseName, iso, count, inputFn, trialFn, oracleFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_indexed_tb( \
+        (count), TESTA_IMPL_FN(inputFn), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn)))
+
+#define TESTA_DEF_EQ_WITH_INDEXED_TB(caseName, count, inputFn, trialFn, oracleFn) \
+    TESTA_DEF_EQ_WITH_INDEXED_TB_ISO(caseName, Unit, count, inputFn, trialFn, oracleFn)
+
+#define TESTA_DEF_VERIFY_WITH_PAR_TB_ISO(caseName, iso, caseTb, caseVerfier, trialFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::VerifyCase::with_par_tb( \
+        #caseName, (caseTb), TESTA_IMPL_FN(caseVerfier), TESTA_IMPL_FN(trialFn)))
+
+#define TESTA_DEF_VERIFY_WITH_PAR_TB(caseName, caseTb, caseVerfier, trialFn) \
+    TESTA_DEF_VERIFY_WITH_PAR_TB_ISO(caseName, Unit, caseTb, caseVerfier, trialFn)
+
+#define TESTA_DEF_VERIFY_WITH_INDEXED_TB_ISO(caseName, iso, count, inputFn, caseVerfier, trialFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::VerifyCase::with_indexed_tb( \
+        (count), TESTA_IMPL_FN(inputFn), TESTA_IMPL_FN(caseVerfier), TESTA_IMPL_FN(trialFn)))
+
+#define TESTA_DEF_VERIFY_WITH_INDEXED_TB(caseName, count, inputFn, caseVerfier, trialFn) \
+    TESTA_DEF_VERIFY_WITH_INDEXED_TB_ISO(caseName, Unit, count, inputFn, caseVerfier, trialFn)
+
+// Inputs are records of a corpus file, as Corpus describes,
+// passed to trialFn, oracleFn and caseVerifier as `std::string_view`.
+// They are checked by all cores in chunks, as TESTA_DEF_XXX_WITH_PAR_TB does.
+// `path` is a string literal, relative to the directory of the executable,
+// and is declared as a dependency of the case by TESTA_DEPS.
+#define TESTA_DEF_EQ_WITH_CORPUS_ISO(caseName, iso, path, trialFn, oracleFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::EqCase::with_corpus( \
+        (path), TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn))); \
+    TESTA_DEPS(caseName, path)
+
+#define TESTA_DEF_EQ_WITH_CORPUS(caseName, path, trialFn, oracleFn) \
+    TESTA_DEF_EQ_WITH_CORPUS_ISO(caseName, Unit, path, trialFn, oracleFn)
+
+#define TESTA_DEF_VERIFY_WITH_CORPUS_ISO(caseName, iso, path, caseVerfier, trialFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::VerifyCase::with_corpus( \
+        (path), TESTA_IMPL_FN(caseVerfier), TESTA_IMPL_FN(trialFn))); \
+    TESTA_DEPS(caseName, path)
+
+#define TESTA_DEF_VERIFY_WITH_CORPUS(caseName, path, caseVerfier, trialFn) \
+    TESTA_DEF_VERIFY_WITH_CORPUS_ISO(caseName, Unit, path, caseVerfier, trialFn)
+
+// Differential fuzzing: trialFn must agree with oracleFn on inputs of types in `...`,
+// which are decoded from bytes generated by a fuzzer, as FuzzDecode describes.
+// Passed as separated arguments if trialFn and oracleFn accept, or as a tuple otherwise.
+// Fuzzing is guided by edge coverage of code compiled with `-fsanitize-coverage=trace-pc`,
+// as cmake option TESTA_FUZZ does, or is blind otherwise.
+// In a normal run, the case fuzzes a short and deterministic round,
+// and `--fuzz` of the test executable fuzzes it for real.
+#define TESTA_DEF_FUZZ_ISO(caseName, iso, trialFn, oracleFn, ...) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::FuzzCase::run<__VA_ARGS__>( \
+        #caseName, TESTA_IMPL_FN(trialFn), TESTA_IMPL_FN(oracleFn)))
+
+#define TESTA_DEF_FUZZ(caseName, trialFn, oracleFn, ...) \
+    TESTA_DEF_FUZZ_ISO(caseName, Unit, trialFn, oracleFn, __VA_ARGS__)
+
+#define TESTA_DEF_JUNIT_LIKE2_ISO(caseName, iso, tbVerifier) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, (tbVerifier)(::std::string(#caseName)))
 
 #define TESTA_DEF_JUNIT_LIKE2(caseName, tbVerifier) \
-    testa::_impl::VerifyCase cs##caseName(#caseName, tbVerifier)
+    TESTA_DEF_JUNIT_LIKE2_ISO(caseName, Unit, tbVerifier)
+
+#define TESTA_DEF_JUNIT_LIKE1_ISO(caseName, iso) \
+    TESTA_DEF_JUNIT_LIKE2_ISO(caseName, iso, caseName)
 
 #define TESTA_DEF_JUNIT_LIKE1(caseName) \
     TESTA_DEF_JUNIT_LIKE2(caseName, caseName)
 
+
+// A micro-benchmark of `benchFn`, which takes no argument.
+// Its result, if any, is kept from being optimized away.
+#define TESTA_DEF_BENCH_ISO(caseName, iso, benchFn) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::BenchCase::run( \
+        #caseName, TESTA_IMPL_FN(benchFn)))
+
+#define TESTA_DEF_BENCH(caseName, benchFn) \
+    TESTA_DEF_BENCH_ISO(caseName, Functional, benchFn)
+
+// A thread-scaling case of `opFn`, which takes the index of the calling thread and does an operation.
+// Parallel efficiency at n threads is the throughput divided by n times that at a single thread.
+// It must be at least `minEfficiency`, e.g., 0.7, at every point.
+#define TESTA_DEF_SCALING_ISO(caseName, iso, opFn, maxThreads, minEfficiency) \
+    TESTA_IMPL_DEF_CASE(caseName, iso, ::testa::_impl::ScalingCase::run( \
+        #caseName, TESTA_IMPL_FN(opFn), (maxThreads), (minEfficiency)))
+
+#define TESTA_DEF_SCALING(caseName, opFn, maxThreads, minEfficiency) \
+    TESTA_DEF_SCALING_ISO(caseName, Functional, opFn, maxThreads, minEfficiency)
@@ -0,0 +1,455 @@
+// An in-process fuzzer in the manner of AFL and libFuzzer.
+// Code under test compiled with `-fsanitize-coverage=trace-pc` calls back
+// __sanitizer_cov_trace_pc() on every basic block, which counts edges into a map.
+// This file itself must not be instrumented.
+#include "testa.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+#ifdef ENABLE_STD_FORMAT
+using std::format_to;
+#endif
+#ifdef ENABLE_FMTLIB
+using fmt::format_to;
+#endif
+
+namespace {
+
+constexpr size_t kMapSize = 1 << 16;
+
+// Edge counters of the fuzzer executing a target in this thread, or nullptr if none.
+// Each fuzzer has counters of its own, so neither other threads nor other cases race on them.
+constinit thread_local unsigned char* tEdges = nullptr;
+constinit thread_local uintptr_t tPrevLoc = 0;
+
+}
+
+// Weak, so that a real sanitizer coverage runtime, e.g., libFuzzer, takes precedence,
+// and fuzzing here goes blind then.
+extern "C" __attribute__((weak, no_sanitize_coverage))
+void __sanitizer_cov_trace_pc()
+{
+    unsigned char* edges = tEdges;
+    if (edges == nullptr) {
+        return;
+    }
+    uintptr_t pc = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+    uintptr_t loc = (pc ^ (pc >> 15)) * 0x9E3779B1u;
+    ++edges[(loc ^ tPrevLoc) & (kMapSize - 1)];
+    tPrevLoc = loc >> 1;
+}
+
+// Provided by sanitizers, if any.
+extern "C" void __sanitizer_set_death_callback(void (*callback)()) __attribute__((weak));
+
+namespace testa::_impl {
+
+namespace {
+
+// limits of normal runs, which are short and deterministic
+constexpr uint64_t kQuickRuns = 10000;
+constexpr size_t kMaxLen = 4096;
+constexpr size_t kMinimizeRuns = 10000;
+
+FuzzOptions gFuzzOptions;
+
+// The input being run, and where to save it if the process crashes.
+const string* gCurrentInput = nullptr;
+char gCrashDir[4096];
+
+string input_name(string_view in)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) case_hash(in));
+    return buf;
+}
+
+// Async-signal-safe, since it is called on crashes.
+void save_crashed_input()
+{
+    const string* in = gCurrentInput;
+    if (in == nullptr) {
+        return;
+    }
+    gCurrentInput = nullptr;
+    char path[sizeof(gCrashDir) + 32];
+    size_t n = strlen(gCrashDir);
+    memcpy(path, gCrashDir, n);
+    memcpy(path + n, "crash-", 6);
+    n += 6;
+    uint64_t h = case_hash(*in);
+    for(int i = 60; i >= 0; i -= 4) {
+        path[n++] = "0123456789abcdef"[(h >> i) & 15];
+    }
+    path[n] = '\0';
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ssize_t w = write(fd, in->data(), in->size());
+        (void) w;
+        close(fd);
+    }
+    const char msg[] = "fuzz: the process crashed, and the input is saved to ";
+    ssize_t w = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    w = write(STDERR_FILENO, path, n);
+    w = write(STDERR_FILENO, "\n", 1);
+    (void) w;
+}
+
+void on_crash(int sig)
+{
+    save_crashed_input();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void install_crash_handlers(const string& dir)
+{
+    string prefix = dir.empty() ? string() : dir + "/";
+    snprintf(gCrashDir, sizeof(gCrashDir), "%s", prefix.c_str());
+    for(int sig: {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+        signal(sig, on_crash);
+    }
+    if (__sanitizer_set_death_callback != nullptr) {
+        __sanitizer_set_death_callback(save_crashed_input);
+    }
+}
+
+// Bucket of a hit count, as AFL does: 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and 128+.
+unsigned char hit_bit(unsigned char cnt)
+{
+    static constexpr unsigned char kBits[] = {
+        0, 1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 3, 1 << 3, 1 << 3};
+    if (cnt < 8) {
+        return kBits[cnt];
+    } else if (cnt < 16) {
+        return 1 << 4;
+    } else if (cnt < 32) {
+        return 1 << 5;
+    } else if (cnt < 128) {
+        return 1 << 6;
+    } else {
+        return 1 << 7;
+    }
+}
+
+class Fuzzer {
+public:
+    Fuzzer(const char* caseName, const function<void(string_view)>& target)
+    :   _caseName(caseName),
+        _target(target),
+        _opts(gFuzzOptions),
+        _edges(kMapSize),
+        _seen(kMapSize),
+        _rng(_opts.enabled ? random_device()() : 0)
+    {}
+
+    void run();
+
+private:
+    // Whether the input fails, with the exception in `failure`.
+    bool execute(const string& in, exception_ptr& failure);
+
+    // Whether the last execution covers any new edge or hit count.
+    bool collect();
+
+    void add(string in);
+    string mutate(const string& in);
+    string minimize(string in);
+    void save(const string& name, const string& in) const;
+    [[noreturn]] void fail(const string& in, exception_ptr failure);
+    void report(bool last) const;
+
+    const char* _caseName;
+    const function<void(string_view)>& _target;
+    const FuzzOptions _opts;
+    vector<unsigned char> _edges;
+    vector<unsigned char> _seen;
+    size_t _features = 0;
+    vector<string> _corpus;
+    mt19937_64 _rng;
+    uint64_t _runs = 0;
+    chrono::steady_clock::time_point _start;
+};
+
+bool Fuzzer::execute(const string& in, exception_ptr& failure)
+{
+    fill(_edges.begin(), _edges.end(), 0);
+    tPrevLoc = 0;
+    tEdges = _edges.data();
+    gCurrentInput = &in;
+    ++_runs;
+    try {
+        _target(in);
+    } catch (...) {
+        failure = current_exception();
+    }
+    tEdges = nullptr;
+    gCurrentInput = nullptr;
+    return failure != nullptr;
+}
+
+bool Fuzzer::collect()
+{
+    bool found = false;
+    for(size_t w = 0; w < kMapSize / 8; ++w) {
+        // skips 8 zero counters at a time. memcpy, rather than a cast, reads them without aliasing.
+        uint64_t word;
+        memcpy(&word, _edges.data() + w * 8, sizeof(word));
+        if (word == 0) {
+            continue;
+        }
+        for(size_t i = w * 8; i < w * 8 + 8; ++i) {
+            unsigned char bit = hit_bit(_edges[i]);
+            if ((_seen[i] & bit) != bit) {
+                _seen[i] |= bit;
+                ++_features;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+void Fuzzer::add(string in)
+{
+    if (!_opts.dir.empty()) {
+        save(input_name(in), in);
+    }
+    _corpus.push_back(std::move(in));
+}
+
+string Fuzzer::mutate(const string& in)
+{
+    static constexpr unsigned char kInteresting[] = {0, 1, 0x7f, 0x80, 0xff, 16, 32, 64, 100};
+    string res = in;
+    int rounds = 1 + _rng() % 4;
+    for(int r = 0; r < rounds; ++r) {
+        size_t pos = res.empty() ? 0 : _rng() % res.size();
+        switch (res.empty() ? 2 : _rng() % 8) {
+        case 0:
+            res[pos] ^= char(1 << (_rng() % 8));
+            break;
+        case 1:
+            res[pos] = char(_rng());
+            break;
+        case 2: {
+            // inserts random bytes
+            size_t at = _rng() % (res.size() + 1);
+            size_t len = 1 + _rng() % 16;
+            string bytes(len, '\0');
+            for(char& c: bytes) {
+                c = char(_rng());
+            }
+            res.insert(at, bytes);
+            break;
+        }
+        case 3:
+            res.erase(pos, 1 + _rng() % min<size_t>(8, res.size() - pos));
+            break;
+        case 4:
+            res[pos] = char(kInteresting[_rng() % size(kInteresting)]);
+            break;
+        case 5:
+            res[pos] = char(res[pos] + int(_rng() % 35) - 17);
+            break;
+        case 6: {
+            // copies a chunk onto another place
+            size_t len = 1 + _rng() % min<size_t>(16, res.size() - pos);
+            string chunk = res.substr(pos, len);
+            res.replace(_rng() % res.size(), len, chunk);
+            break;
+        }
+        default: {
+            // splices with another input
+            const string& other = _corpus[_rng() % _corpus.size()];
+            if (!other.empty()) {
+                size_t from = _rng() % other.size();
+                res = res.substr(0, pos) + other.substr(from);
+            }
+            break;
+        }
+        }
+        if (res.size() > kMaxLen) {
+            res.resize(kMaxLen);
+        }
+    }
+    return res;
+}
+
+string Fuzzer::minimize(string in)
+{
+    exception_ptr failure;
+    size_t budget = kMinimizeRuns;
+    // Drops chunks, halving their sizes.
+    for(size_t chunk = in.size(); chunk > 0 && budget > 0; chunk /= 2) {
+        for(size_t i = 0; i + chunk <= in.size() && budget > 0; --budget) {
+            string cand = in.substr(0, i) + in.substr(i + chunk);
+            failure = nullptr;
+            if (execute(cand, failure)) {
+                in = std::move(cand);
+            } else {
+                i += chunk;
+            }
+        }
+    }
+    // Zeros bytes.
+    for(size_t i = 0; i < in.size() && budget > 0; ++i) {
+        if (in[i] == 0) {
+            continue;
+        }
+        --budget;
+        string cand = in;
+        cand[i] = 0;
+        failure = nullptr;
+        if (execute(cand, failure)) {
+            in = std::move(cand);
+        }
+    }
+    return in;
+}
+
+void Fuzzer::save(const string& name, const string& in) const
+{
+    ofstream out(filesystem::path(_opts.dir) / name, ios::binary);
+    out.write(in.data(), in.size());
+}
+
+void Fuzzer::fail(const string& in, exception_ptr failure)
+{
+    string minimized = minimize(in);
+    fprintf(stderr, "fuzz: %s fails after %llu runs, on an input minimized from %zu to %zu bytes\n",
+        _caseName, (unsigned long long) _runs, in.size(), minimized.size());
+    // Only real fuzzing saves failed inputs, while normal runs are reproducible anyway.
+    if (_opts.enabled) {
+        string name = "crash-" + input_name(minimized);
+        string path = _opts.dir.empty() ? name : (filesystem::path(_opts.dir) / name).string();
+        ofstream out(path, ios::binary);
+        out.write(minimized.data(), minimized.size());
+        fprintf(stderr, "fuzz: the input is saved to %s\n", path.c_str());
+    }
+    report(true);
+    // Fails again, so the failure is reported as usual.
+    _target(minimized);
+    rethrow_exception(failure);
+}
+
+void Fuzzer::report(bool last) const
+{
+    chrono::duration<double> secs = chrono::steady_clock::now() - _start;
+    double rate = _runs / max(secs.count(), 1e-9);
+    if (_opts.enabled) {
+        fprintf(stderr, "#%llu\tcov: %zu\tcorpus: %zu\texec/s: %.0f\n",
+            (unsigned long long) _runs, _features, _corpus.size(), rate);
+    }
+    if (last) {
+        string json;
+        format_to(back_inserter(json),
+            "{{\"name\":\"{}\",\"runs\":{},\"seconds\":{:.3f},\"execs_per_sec\":{:.0f},"
+            "\"features\":{},\"corpus\":{}}}",
+            _caseName, _runs, secs.count(), rate, _features, _corpus.size());
+        emit_record("fuzz", json);
+    }
+}
+
+void Fuzzer::run()
+{
+    _start = chrono::steady_clock::now();
+    if (_opts.enabled) {
+        install_crash_handlers(_opts.dir);
+    }
+    // Seeds, among which failed inputs saved before run first.
+    vector<string> seeds;
+    if (!_opts.dir.empty()) {
+        filesystem::create_directories(_opts.dir);
+        vector<filesystem::path> files;
+        for(const auto& entry: filesystem::directory_iterator(_opts.dir)) {
+            if (entry.is_regular_file()) {
+                files.push_back(entry.path());
+            }
+        }
+        sort(files.begin(), files.end(), [](const auto& a, const auto& b) {
+            bool ca = a.filename().string().starts_with("crash-");
+            bool cb = b.filename().string().starts_with("crash-");
+            return ca != cb ? ca : a < b;
+        });
+        for(const auto& fn: files) {
+            ifstream f(fn, ios::binary);
+            seeds.emplace_back(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+        }
+    }
+    seeds.emplace_back();
+    for(const string& in: seeds) {
+        exception_ptr failure;
+        if (execute(in, failure)) {
+            fail(in, failure);
+        }
+        if (collect() || _corpus.empty()) {
+            _corpus.push_back(in);
+        }
+    }
+    if (_opts.enabled && _features == 0) {
+        fprintf(stderr, "fuzz: no coverage is seen, so fuzzing is blind."
+            " Compile code under test with -fsanitize-coverage=trace-pc.\n");
+    }
+
+    uint64_t maxRuns = _opts.enabled ? UINT64_MAX : kQuickRuns;
+    auto deadline = chrono::steady_clock::time_point::max();
+    if (_opts.enabled && _opts.seconds > 0) {
+        deadline = _start + chrono::duration_cast<chrono::steady_clock::duration>(
+            chrono::duration<double>(_opts.seconds));
+    }
+    uint64_t nextReport = 1024;
+    while(_runs < maxRuns) {
+        if ((_runs & 255) == 0 && chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        string in = mutate(_corpus[_rng() % _corpus.size()]);
+        exception_ptr failure;
+        if (execute(in, failure)) {
+            fail(in, failure);
+        }
+        if (collect()) {
+            add(std::move(in));
+        }
+        if (_runs >= nextReport) {
+            report(false);
+            nextReport *= 2;
+        }
+    }
+    report(true);
+}
+
+}
+
+const FuzzOptions& fuzz_options()
+{
+    return gFuzzOptions;
+}
+
+void select_fuzz(const FuzzOptions& opts)
+{
+    gFuzzOptions = opts;
+}
+
+void run_fuzz(const char* caseName, const function<void(string_view)>& target)
+{
+    Fuzzer(caseName, target).run();
+}
+
+}
@@ -0,0 +1,357 @@
+#pragma once
+
+#include "testa.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace testa {
+
+// SplitMix64. Small and fast, and good enough for generating inputs.
+class Rng {
+public:
+    explicit Rng(::std::uint64_t seed)
+    :   _state(seed)
+    {}
+
+    ::std::uint64_t operator()()
+    {
+        ::std::uint64_t z = (_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, n), for n > 0.
+    ::std::uint64_t below(::std::uint64_t n)
+    {
+        return ::std::uint64_t((unsigned __int128) (*this)() * n >> 64);
+    }
+
+private:
+    ::std::uint64_t _state;
+};
+
+// Random values of type T, and smaller variants of them to shrink failed inputs.
+// Specialize it for other types, with
+//   static T generate(Rng& rng);
+//   // smaller variants of `x`, simpler ones first, or none if `x` is the simplest
+//   static std::vector<T> shrink(const T& x);
+template<class T, class Enable = void>
+struct Arbitrary;
+
+// Small values, boundaries and arbitrary bits, each a third of the time or so.
+// Shrunk towards 0.
+template<class T>
+struct Arbitrary<T, ::std::enable_if_t<::std::is_integral_v<T> && !::std::is_same_v<T, bool>>> {
+    static T generate(Rng& rng)
+    {
+        switch (rng.below(3)) {
+        case 0:
+            if constexpr (::std::is_signed_v<T>) {
+                return T(::std::int64_t(rng.below(33)) - 16);
+            } else {
+                return T(rng.below(33));
+            }
+        case 1: {
+            const T bounds[] = {
+                T(0), T(1), T(~T(0)),
+                ::std::numeric_limits<T>::min(), ::std::numeric_limits<T>::max()};
+            return bounds[rng.below(5)];
+        }
+        default:
+            return T(rng());
+        }
+    }
+
+    static ::std::vector<T> shrink(const T& x)
+    {
+        ::std::vector<T> res;
+        if (x == 0) {
+            return res;
+        }
+        res.push_back(0);
+        if constexpr (::std::is_signed_v<T>) {
+            if (x < 0 && x != ::std::numeric_limits<T>::min()) {
+                res.push_back(-x);
+            }
+        }
+        if (x / 2 != 0) {
+            res.push_back(x / 2);
+        }
+        T closer = (x > 0) ? T(x - 1) : T(x + 1);
+        if (closer != 0 && closer != x / 2) {
+            res.push_back(closer);
+        }
+        return res;
+    }
+};
+
+template<>
+struct Arbitrary<bool> {
+    static bool generate(Rng& rng)
+    {
+        return rng() & 1;
+    }
+
+    static ::std::vector<bool> shrink(const bool& x)
+    {
+        return x ? ::std::vector<bool>{false} : ::std::vector<bool>{};
+    }
+};
+
+// Finite values only, since NaN never equals itself.
+template<class T>
+struct Arbitrary<T, ::std::enable_if_t<::std::is_floating_point_v<T>>> {
+    static T generate(Rng& rng)
+    {
+        switch (rng.below(3)) {
+        case 0:
+            return T(::std::int64_t(rng.below(33)) - 16);
+        case 1:
+            return T(rng.below(1 << 24)) / T(1 << 12) - T(1 << 11);
+        default: {
+            const T bounds[] = {
+                T(0), T(-0.0), ::std::numeric_limits<T>::min(),
+                ::std::numeric_limits<T>::max(), ::std::numeric_limits<T>::lowest()};
+            return bounds[rng.below(5)];
+        }
+        }
+    }
+
+    static ::std::vector<T> shrink(const T& x)
+    {
+        ::std::vector<T> res;
+        if (x == 0) {
+            return res;
+        }
+        res.push_back(0);
+        if (x < 0) {
+            res.push_back(-x);
+        }
+        T whole = ::std::trunc(x);
+        if (whole != x) {
+            res.push_back(whole);
+        }
+        if (x / 2 != x) {
+            res.push_back(x / 2);
+        }
+        return res;
+    }
+};
+
+namespace _impl {
+
+// Up to kGenMaxLength elements per container, so inputs are generated fast.
+constexpr ::std::size_t kGenMaxLength = 16;
+
+// Shrinks a sequence by dropping halves, and then single elements,
+// and then by shrinking single elements.
+template<class Seq, class Elem>
+::std::vector<Seq> shrink_seq(const Seq& xs)
+{
+    ::std::vector<Seq> res;
+    ::std::size_t n = xs.size();
+    if (n == 0) {
+        return res;
+    }
+    res.push_back(Seq());
+    if (n > 1) {
+        res.push_back(Seq(xs.begin(), xs.begin() + n / 2));
+        res.push_back(Seq(xs.begin() + n / 2, xs.end()));
+    }
+    for(::std::size_t i = 0; i < n && n > 1; ++i) {
+        Seq ys = xs;
+        ys.erase(ys.begin() + i);
+        res.push_back(::std::move(ys));
+    }
+    for(::std::size_t i = 0; i < n; ++i) {
+        for(auto&& y: Arbitrary<Elem>::shrink(xs[i])) {
+            Seq ys = xs;
+            ys[i] = ::std::move(y);
+            res.push_back(::std::move(ys));
+        }
+    }
+    return res;
+}
+
+template<class Tuple, ::std::size_t... Is>
+::std::vector<Tuple> shrink_tuple(const Tuple& x, ::std::index_sequence<Is...>)
+{
+    ::std::vector<Tuple> res;
+    auto shrinkAt = [&]<::std::size_t I>(::std::integral_constant<::std::size_t, I>) {
+        using Elem = ::std::tuple_element_t<I, Tuple>;
+        for(auto&& y: Arbitrary<Elem>::shrink(::std::get<I>(x))) {
+            Tuple z = x;
+            ::std::get<I>(z) = ::std::move(y);
+            res.push_back(::std::move(z));
+        }
+    };
+    (shrinkAt(::std::integral_constant<::std::size_t, Is>()), ...);
+    return res;
+}
+
+}
+
+// Mostly printable characters.
+template<>
+struct Arbitrary<::std::string> {
+    static ::std::string generate(Rng& rng)
+    {
+        ::std::string res(rng.below(_impl::kGenMaxLength + 1), '\0');
+        for(char& c: res) {
+            ::std::uint64_t r = rng();
+            c = (r & 7) ? char(' ' + (r >> 8) % 95) : char(r >> 8);
+        }
+        return res;
+    }
+
+    static ::std::vector<::std::string> shrink(const ::std::string& x)
+    {
+        return _impl::shrink_seq<::std::string, char>(x);
+    }
+};
+
+template<class T>
+struct Arbitrary<::std::vector<T>> {
+    static ::std::vector<T> generate(Rng& rng)
+    {
+        ::std::size_t n = rng.below(_impl::kGenMaxLength + 1);
+        ::std::vector<T> res;
+        res.reserve(n);
+        for(::std::size_t i = 0; i < n; ++i) {
+            res.push_back(Arbitrary<T>::generate(rng));
+        }
+        return res;
+    }
+
+    static ::std::vector<::std::vector<T>> shrink(const ::std::vector<T>& x)
+    {
+        return _impl::shrink_seq<::std::vector<T>, T>(x);
+    }
+};
+
+template<class T>
+struct Arbitrary<::std::optional<T>> {
+    static ::std::optional<T> generate(Rng& rng)
+    {
+        if (rng.below(4) == 0) {
+            return ::std::nullopt;
+        }
+        return Arbitrary<T>::generate(rng);
+    }
+
+    static ::std::vector<::std::optional<T>> shrink(const ::std::optional<T>& x)
+    {
+        ::std::vector<::std::optional<T>> res;
+        if (!x) {
+            return res;
+        }
+        res.push_back(::std::nullopt);
+        for(auto&& y: Arbitrary<T>::shrink(*x)) {
+            res.push_back(::std::move(y));
+        }
+        return res;
+    }
+};
+
+template<class... Ts>
+struct Arbitrary<::std::tuple<Ts...>> {
+    static ::std::tuple<Ts...> generate(Rng& rng)
+    {
+        // Elements of a braced list are evaluated from left to right.
+        return ::std::tuple<Ts...>{Arbitrary<Ts>::generate(rng)...};
+    }
+
+    static ::std::vector<::std::tuple<Ts...>> shrink(const ::std::tuple<Ts...>& x)
+    {
+        return _impl::shrink_tuple(x, ::std::index_sequence_for<Ts...>());
+    }
+};
+
+template<class A, class B>
+struct Arbitrary<::std::pair<A, B>> {
+    static ::std::pair<A, B> generate(Rng& rng)
+    {
+        A a = Arbitrary<A>::generate(rng);
+        B b = Arbitrary<B>::generate(rng);
+        return ::std::pair<A, B>(::std::move(a), ::std::move(b));
+    }
+
+    static ::std::vector<::std::pair<A, B>> shrink(const ::std::pair<A, B>& x)
+    {
+        return _impl::shrink_tuple(x, ::std::index_sequence_for<A, B>());
+    }
+};
+
+// The `idx`-th random input of seed `kSeed`.
+// Each input has a generator of its own, so inputs are the same however they are sharded,
+// and can be generated by many threads without locks,
+// e.g., as inputFn of TESTA_DEF_XXX_WITH_INDEXED_TB.
+template<class T, ::std::uint64_t kSeed = 0>
+T random_input(::std::size_t idx)
+{
+    Rng rng(Rng(kSeed ^ (idx * 0xD1B54A32D192ED03ull))());
+    return Arbitrary<T>::generate(rng);
+}
+
+namespace _impl {
+
+constexpr ::std::size_t kShrinkRuns = 10000;
+
+// Shrinks input `x` failing `cs` into a minimal one, which still fails,
+// and then rethrows its failure.
+template<class T, class Check>
+[[noreturn]] void shrink_failure(::std::size_t idx, T x, const Check& cs, ::std::exception_ptr failure)
+{
+    ShrinkScope scope(idx);
+    ::std::size_t budget = kShrinkRuns;
+    for(bool shrunk = true; shrunk && budget > 0;) {
+        shrunk = false;
+        for(auto&& y: Arbitrary<T>::shrink(x)) {
+            if (budget == 0) {
+                break;
+            }
+            --budget;
+            try {
+                cs(y);
+            } catch (const ::std::exception&) {
+                x = ::std::move(y);
+                failure = ::std::current_exception();
+                shrunk = true;
+                break;
+            }
+        }
+    }
+    ::std::rethrow_exception(failure);
+}
+
+}
+
+// A testbench feeding `kCount` random inputs of seed `kSeed`,
+// whose failed input, if any, is shrunk into a minimal one before reported.
+// Under TESTA_DEF_XXX_WITH_PAR_TB, failures are found after the testbench returns,
+// so they are reported as they are.
+template<class T, ::std::size_t kCount = 100000, ::std::uint64_t kSeed = 0>
+void random_tb(const ::std::string&, ::std::function<void(const T&)> cs)
+{
+    for(::std::size_t i = 0; i < kCount; ++i) {
+        T x = random_input<T, kSeed>(i);
+        try {
+            cs(x);
+        } catch (const ::std::exception&) {
+            _impl::shrink_failure(i, ::std::move(x), cs, ::std::current_exception());
+        }
+    }
+}
+
+}
@@ -1,21 +1,425 @@
 #include "testa.hpp"
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <optional>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace std;
 
+#ifdef TESTA_COVERAGE
+extern "C" void __gcov_dump();
+#endif
+
 namespace {
 
+#ifdef TESTA_COVERAGE
+terminate_handler gPrevTerminate = nullptr;
+
+// Failed cases end by std::terminate(), which skips gcov writing out counters at exit.
+[[noreturn]] void terminate_with_gcov()
+{
+    __gcov_dump();
+    gPrevTerminate();
+    abort();
+}
+#endif
+
 void print_usage(string exe)
 {
-    printf("%s [--help|-h] [--show-cases] [CASENAME]\n", exe.c_str());
+    printf("%s [--help|-h] [--show-cases] [[--perf] --serve] [--run-pure]"
+        " [[--perf] [--input INDEX|--from INDEX] CASENAME]"
+        " [--fuzz [--fuzz-seconds SECONDS] [--fuzz-dir DIR] CASENAME]\n", exe.c_str());
     printf("CASENAME\ta case name that will be executed\n");
-    printf("--show-cases\ta list of case names, one name per line\n");
+    printf("--show-cases\ta json list of cases, with their names, isolation levels, source locations\n"
+        "\tand data dependencies if declared\n");
+    printf("--serve\tread requests \"CASENAME\\tSTDOUT\\tSTDERR\" from stdin, one per line,\n"
+        "\tand run each case in a forked child, leading a process group of its own,\n"
+        "\twhose outputs are appended to STDOUT and STDERR.\n"
+        "\tFor each request, \"started PID\" and then \"exited CODE USAGE\" or \"signaled SIGNAL USAGE\"\n"
+        "\tare replied to stdout, where USAGE is resource usage of the child:\n"
+        "\tmax RSS in KB, user and system cpu time in microseconds, minor and major page faults,\n"
+        "\tand voluntary and involuntary context switches.\n");
+    printf("--run-pure\tread names of pure cases from stdin, one per line,\n"
+        "\tand run them by a thread pool in this process.\n"
+        "\tFor each case, a json object with \"name\", \"result\", \"duration\", \"message\"\n"
+        "\tand \"output\", the ##testa: records of the case, is replied to stdout in a single line.\n"
+        "\tOther outputs of cases are redirected to stderr.\n"
+        "\tThe pool runs TESTA_THREADS threads, or as many as cpu cores,\n"
+        "\tand parallel testbenches of cases run inline in them.\n");
+    printf("--perf\tcount instructions, cycles, branch misses, cache misses and task-clock\n"
+        "\tof each case by perf_event_open, or only software counters if hardware ones are unavailable,\n"
+        "\tor resource usage if perf_event_open is unavailable at all,\n"
+        "\tand write them to stdout as a \"perf\" record.\n");
+    printf("--input INDEX\tcheck only the input of INDEX, counted from 0, produced by the testbench of CASENAME,\n"
+        "\tas reported by a failure.\n");
+    printf("--from INDEX\tcheck inputs from INDEX on, skipping those before it.\n");
+    printf("--fuzz\tfuzz CASENAME, defined by TESTA_DEF_FUZZ, until it fails,\n"
+        "\tor for SECONDS if --fuzz-seconds is given.\n"
+        "\tInputs of new coverage and the minimized failed input are saved to DIR if --fuzz-dir is given,\n"
+        "\tand inputs saved there before are run first.\n");
     printf("--help,-h\tthis help message\n");
 }
 
+bool parse_index(const char* s, size_t& idx)
+{
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long v = strtoull(s, &end, 10);
+    if (*s == '\0' || *end != '\0' || errno != 0 || s[0] == '-') {
+        return false;
+    }
+    idx = v;
+    return true;
+}
+
+bool gPerf = false;
+
+// Counters of the calling process and threads created afterwards.
+class PerfCounters {
+public:
+    PerfCounters()
+    {
+        struct {
+            const char* name;
+            uint32_t type;
+            uint64_t config;
+        } events[] = {
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {"task_clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+        };
+        for(const auto& ev: events) {
+            int fd = open_counter(ev.type, ev.config);
+            if (fd >= 0) {
+                _counters.push_back({ev.name, fd});
+                if (ev.type == PERF_TYPE_HARDWARE) {
+                    _source = "hardware";
+                } else if (_source == "rusage") {
+                    _source = "software";
+                }
+            }
+        }
+    }
+
+    ~PerfCounters()
+    {
+        for(const auto& c: _counters) {
+            close(c.fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start()
+    {
+        getrusage(RUSAGE_SELF, &_usage);
+        for(const auto& c: _counters) {
+            ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // Stops counting, and returns counters as a json object.
+    string stop(const string& name)
+    {
+        for(const auto& c: _counters) {
+            ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        string res = "{\"name\":\"" + testa::_impl::json_escape(name)
+            + "\",\"source\":\"" + _source + "\"";
+        if (_counters.empty()) {
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            auto nanos = [](const timeval& tv) {
+                return (int64_t) tv.tv_sec * 1000000000 + (int64_t) tv.tv_usec * 1000;
+            };
+            int64_t clock = nanos(usage.ru_utime) + nanos(usage.ru_stime)
+                - nanos(_usage.ru_utime) - nanos(_usage.ru_stime);
+            res += ",\"task_clock\":" + to_string(clock);
+            res += ",\"page_faults\":" + to_string(
+                usage.ru_minflt + usage.ru_majflt - _usage.ru_minflt - _usage.ru_majflt);
+            res += ",\"context_switches\":" + to_string(
+                usage.ru_nvcsw + usage.ru_nivcsw - _usage.ru_nvcsw - _usage.ru_nivcsw);
+        }
+        for(const auto& c: _counters) {
+            // counters are scaled up, in case they are multiplexed.
+            uint64_t vals[3] = {0, 0, 0};
+            if (read(c.fd, vals, sizeof(vals)) != sizeof(vals)) {
+                continue;
+            }
+            uint64_t v = vals[0];
+            if (vals[2] > 0 && vals[2] < vals[1]) {
+                v = (uint64_t) ((double) v * vals[1] / vals[2]);
+            }
+            res += string(",\"") + c.name + "\":" + to_string(v);
+        }
+        res += "}";
+        return res;
+    }
+
+private:
+    static int open_counter(uint32_t type, uint64_t config)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+
+    struct Counter {
+        const char* name;
+        int fd;
+    };
+
+    vector<Counter> _counters;
+    string _source = "rusage";
+    struct rusage _usage;
+};
+
+// Allocations are counted by the calling thread within the case,
+// so that neither start-up nor other cases of the same process are mixed in.
+void run_case(const testa::_impl::CaseDesc& cs)
+{
+    string name = cs.name;
+    testa::AllocScope allocs;
+    optional<PerfCounters> perf;
+    if (gPerf) {
+        perf.emplace();
+        perf->start();
+    }
+    cs.run();
+    if (perf) {
+        testa::_impl::emit_record("perf", perf->stop(name));
+    }
+    if (testa::alloc_counting()) {
+        testa::AllocCounters cnt = allocs.counters();
+        testa::_impl::emit_record("allocs", "{\"name\":\"" + name + "\""
+            + ",\"allocs\":" + to_string(cnt.allocs)
+            + ",\"frees\":" + to_string(cnt.frees)
+            + ",\"bytes\":" + to_string(cnt.bytes)
+            + ",\"peak\":" + to_string(cnt.peak) + "}");
+    }
+}
+
+void run_case(const string& name)
+{
+    const testa::_impl::CaseDesc* cs = testa::_impl::find_case(name);
+    if (cs == nullptr) {
+        abort();
+    }
+    run_case(*cs);
+}
+
+void redirect(const char* fn, int fd)
+{
+    int out = open(fn, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (out < 0) {
+        perror(fn);
+        _exit(1);
+    }
+    if (dup2(out, fd) < 0) {
+        perror("dup2");
+        _exit(1);
+    }
+    close(out);
+}
+
+[[noreturn]] void serve_child(const string& name, const char* out, const char* err)
+{
+    setpgid(0, 0);
+    int null = open("/dev/null", O_RDONLY);
+    if (null >= 0) {
+        dup2(null, STDIN_FILENO);
+        close(null);
+    }
+    redirect(out, STDOUT_FILENO);
+    redirect(err, STDERR_FILENO);
+    run_case(name);
+    fflush(stdout);
+    exit(0);
+}
+
+int run_pure()
+{
+    vector<string> names;
+    char* line = nullptr;
+    size_t cap = 0;
+    for(;;) {
+        ssize_t len = getline(&line, &cap, stdin);
+        if (len < 0) {
+            break;
+        }
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (len > 0) {
+            names.push_back(line);
+        }
+    }
+    free(line);
+
+    // replies go to the original stdout, and outputs of cases go to stderr.
+    FILE* replies = fdopen(dup(STDOUT_FILENO), "w");
+    if (replies == nullptr) {
+        perror("fdopen");
+        return 1;
+    }
+    fflush(stdout);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    atomic<size_t> next(0);
+    mutex replyMtx;
+    auto worker = [&]() {
+        testa::_impl::tInlinePools = true;
+        for(;;) {
+            size_t idx = next.fetch_add(1);
+            if (idx >= names.size()) {
+                break;
+            }
+            const string& name = names[idx];
+            string result = "PASS";
+            string message;
+            string records;
+            testa::_impl::tRecordSink = &records;
+            auto start = chrono::steady_clock::now();
+            const testa::_impl::CaseDesc* cs = testa::_impl::find_case(name);
+            if (cs == nullptr) {
+                result = "FAILED";
+                message = "no such case";
+            } else if (cs->isolation != testa::Isolation::Pure) {
+                result = "FAILED";
+                message = "not a pure case";
+            } else {
+                try {
+                    run_case(*cs);
+                } catch (const exception& ex) {
+                    result = "FAILED";
+                    message = ex.what();
+                } catch (...) {
+                    result = "FAILED";
+                    message = "unknown exception";
+                }
+            }
+            chrono::duration<double> dur = chrono::steady_clock::now() - start;
+            testa::_impl::tRecordSink = nullptr;
+            lock_guard<mutex> lk(replyMtx);
+            fprintf(replies,
+                "{\"name\":\"%s\",\"result\":\"%s\",\"duration\":%.6f,\"message\":\"%s\",\"output\":\"%s\"}\n",
+                testa::_impl::json_escape(name).c_str(), result.c_str(), dur.count(),
+                testa::_impl::json_escape(message).c_str(), testa::_impl::json_escape(records).c_str());
+            fflush(replies);
+        }
+    };
+    size_t n = testa::_impl::pool_threads();
+    n = min(n, names.size());
+    vector<thread> threads;
+    for(size_t i = 0; i < n; ++i) {
+        threads.emplace_back(worker);
+    }
+    for(auto& t: threads) {
+        t.join();
+    }
+    fclose(replies);
+    return 0;
+}
+
+int serve()
+{
+    char* line = nullptr;
+    size_t cap = 0;
+    for(;;) {
+        ssize_t len = getline(&line, &cap, stdin);
+        if (len < 0) {
+            break;
+        }
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+        char* out = strchr(line, '\t');
+        char* err = (out == nullptr) ? nullptr : strchr(out + 1, '\t');
+        if (err == nullptr) {
+            fprintf(stderr, "malformed request: %s\n", line);
+            free(line);
+            return 1;
+        }
+        *out++ = '\0';
+        *err++ = '\0';
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            free(line);
+            return 1;
+        }
+        if (pid == 0) {
+            serve_child(line, out, err);
+        }
+        // The child leads a process group of its own, so that it is killed along with its children.
+        // Both sides set it, so the group exists once "started" is replied.
+        setpgid(pid, pid);
+        printf("started %d\n", (int) pid);
+        fflush(stdout);
+
+        int status = 0;
+        struct rusage usage;
+        while (wait4(pid, &status, 0, &usage) < 0) {
+            if (errno != EINTR) {
+                perror("wait4");
+                free(line);
+                return 1;
+            }
+        }
+        if (WIFSIGNALED(status)) {
+            printf("signaled %d", WTERMSIG(status));
+        } else {
+            printf("exited %d", WEXITSTATUS(status));
+        }
+        auto micros = [](const timeval& tv) {
+            return (long long) tv.tv_sec * 1000000 + tv.tv_usec;
+        };
+        printf(" %ld %lld %lld %ld %ld %ld %ld\n",
+            usage.ru_maxrss, micros(usage.ru_utime), micros(usage.ru_stime),
+            usage.ru_minflt, usage.ru_majflt, usage.ru_nvcsw, usage.ru_nivcsw);
+        fflush(stdout);
+    }
+    free(line);
+    return 0;
+}
+
 }
 
 int main(int argv, char** args)
@@ -23,36 +427,79 @@ int main(int argv, char** args)
     if (argv < 1) {
         abort();
     }
+#ifdef TESTA_COVERAGE
+    gPrevTerminate = set_terminate(terminate_with_gcov);
+#endif
     string exe = args[0];
-    if (argv != 2) {
+    int first = 1;
+    testa::_impl::InputRange inputs;
+    testa::_impl::FuzzOptions fuzz;
+    for(; first < argv; ++first) {
+        bool hasValue = first + 1 < argv;
+        if (strcmp(args[first], "--perf") == 0) {
+            gPerf = true;
+        } else if (strcmp(args[first], "--input") == 0 && hasValue
+            && parse_index(args[first + 1], inputs.first))
+        {
+            inputs.last = inputs.first + 1;
+            ++first;
+        } else if (strcmp(args[first], "--from") == 0 && hasValue
+            && parse_index(args[first + 1], inputs.first))
+        {
+            inputs.last = SIZE_MAX;
+            ++first;
+        } else if (strcmp(args[first], "--fuzz") == 0) {
+            fuzz.enabled = true;
+        } else if (strcmp(args[first], "--fuzz-seconds") == 0 && hasValue) {
+            fuzz.seconds = atof(args[++first]);
+        } else if (strcmp(args[first], "--fuzz-dir") == 0 && hasValue) {
+            fuzz.dir = args[++first];
+        } else {
+            break;
+        }
+    }
+    testa::_impl::select_inputs(inputs);
+    testa::_impl::select_fuzz(fuzz);
+    if (argv != first + 1) {
         print_usage(exe);
         return 1;
     }
-    string act = args[1];
+    string act = args[first];
     if (act == "--help" || act == "-h") {
         print_usage(exe);
         return 0;
     } else if (act == "--show-cases") {
-        shared_ptr<testa::_impl::CaseMap> cases = testa::_impl::get_case_map();
-        printf("[\n");
-        auto case_it = cases->begin();
-        if (case_it != cases->end()) {
-            printf("{\"name\":\"%s\"}", case_it->first.c_str());
-            ++case_it;
+        vector<const testa::_impl::CaseDesc*> cases;
+        for(const auto& cs: testa::_impl::all_cases()) {
+            cases.push_back(&cs);
         }
-        for (; case_it != cases->end(); ++case_it) {
-            printf(",\n");
-            printf("{\"name\":\"%s\"}", case_it->first.c_str());
+        sort(cases.begin(), cases.end(), [](const auto* a, const auto* b) {
+            return strcmp(a->name, b->name) < 0;
+        });
+        printf("[\n");
+        for(size_t i = 0; i < cases.size(); ++i) {
+            if (i > 0) {
+                printf(",\n");
+            }
+            printf("{\"name\":\"%s\",\"isolation\":\"%s\",\"file\":\"%s\",\"line\":%d",
+                cases[i]->name,
+                testa::to_string(cases[i]->isolation),
+                testa::_impl::json_escape(cases[i]->file).c_str(),
+                cases[i]->line);
+            const testa::_impl::DepsDesc* deps = testa::_impl::find_deps(cases[i]->name);
+            if (deps != nullptr) {
+                printf(",\"deps\":%s", deps->deps);
+            }
+            printf("}");
         }
         printf("]\n");
         return 0;
+    } else if (act == "--serve") {
+        return serve();
+    } else if (act == "--run-pure") {
+        return run_pure();
     } else {
-        shared_ptr<testa::_impl::CaseMap> cases = testa::_impl::get_case_map();
-        auto cit = cases->find(act);
-        if (cit == cases->end()) {
-            abort();
-        }
-        cit->second();
+        run_case(act);
         return 0;
     }
 }
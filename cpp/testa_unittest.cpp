@@ -1,8 +1,21 @@
 #include "testa.hpp"
+#include "testa_gen.hpp"
 #include "prettyprint.hpp"
 #include <tuple>
 #include <string>
 #include <functional>
+#include <stdexcept>
+#include <vector>
+#include <optional>
+#include <numeric>
+#include <algorithm>
+#include <string_view>
+#include <span>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
 
 using namespace std;
 
@@ -111,6 +124,38 @@ void gcd_wrong_verifier(const int& res, const tuple<int, int>& in)
 TESTA_DEF_VERIFY_WITH_TB(CorrectGcd, gcd_tb, gcd_verifier, gcd);
 TESTA_DEF_VERIFY_WITH_TB(WrongGcd, gcd_tb, gcd_wrong_verifier, gcd);
 
+// Lines of "a b gcd(a, b)" in data/gcd.txt, next to the executable.
+void gcd_table_correct(const string&)
+{
+    auto fn = filesystem::read_symlink("/proc/self/exe").parent_path() / "data" / "gcd.txt";
+    ifstream in(fn);
+    TESTA_ASSERT(in.good())
+        .hint("file={}", fn.string())
+        .issue("cannot open");
+    size_t rows = 0;
+    for(string line; getline(in, line);) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        int a = 0;
+        int b = 0;
+        int expected = 0;
+        istringstream(line) >> a >> b >> expected;
+        int res = gcd(make_tuple(a, b));
+        TESTA_ASSERT(res == expected)
+            .hint("in=({}, {})", a, b)
+            .hint("res={}", res)
+            .hint("expected={}", expected)
+            .issue();
+        ++rows;
+    }
+    TESTA_ASSERT(rows > 0)
+        .hint("file={}", fn.string())
+        .issue("no rows");
+}
+TESTA_DEF_JUNIT_LIKE1(gcd_table_correct);
+TESTA_DEPS(gcd_table_correct, "data/gcd.txt");
+
 int trial1(const int& x)
 {
     return x;
@@ -126,3 +171,345 @@ int trial3(const tuple<int, int, int>& in)
 
 TESTA_DEF_EQ_3(Eq3, trial3, trial3, 1, 2, 3);
 
+TESTA_DEF_EQ_WITH_TB_ISO(PureCorrectMultiple, Pure, permutation_tb, multiply_trial, multiply_oracle);
+TESTA_DEF_EQ_WITH_TB_ISO(PureWrongMultiple, Pure, permutation_tb, add_trial, multiply_oracle);
+TESTA_DEF_VERIFY_WITH_TB_ISO(PureCorrectGcd, Pure, gcd_tb, gcd_verifier, gcd);
+TESTA_DEF_EQ_2_ISO(PureWrongEq2, Pure, add_trial, multiply_trial, 1, 2);
+
+TESTA_DEF_EQ_WITH_PAR_TB(ParCorrectMultiple, permutation_tb, multiply_trial, multiply_oracle);
+TESTA_DEF_EQ_WITH_PAR_TB(ParWrongMultiple, permutation_tb, add_trial, multiply_oracle);
+
+tuple<int, int> gcd_input(size_t idx)
+{
+    return make_tuple(int(idx / 13), int(idx % 13 + 1));
+}
+
+TESTA_DEF_VERIFY_WITH_INDEXED_TB(IndexedCorrectGcd, 13 * 13, gcd_input, gcd_verifier, gcd);
+TESTA_DEF_VERIFY_WITH_INDEXED_TB(IndexedWrongGcd, 13 * 13, gcd_input, gcd_wrong_verifier, gcd);
+
+// Fails in making inputs since the 100th.
+tuple<int, int> gcd_failing_input(size_t idx)
+{
+    TESTA_ASSERT(idx < 100)
+        .hint("idx={}", idx)
+        .issue();
+    return gcd_input(idx);
+}
+
+TESTA_DEF_VERIFY_WITH_INDEXED_TB(IndexedWrongInput, 13 * 13, gcd_failing_input, gcd_verifier, gcd);
+
+// Both gcd_tb and gcd_input produce (i, j) as the (13 * i + j - 1)-th input.
+void input_index_verifier(const int&, const tuple<int, int>& in)
+{
+    size_t idx = testa::_impl::tInputIndex;
+    TESTA_ASSERT(idx == size_t(13 * get<0>(in) + get<1>(in) - 1))
+        .hint("index={}", idx)
+        .hint("in=({})", in)
+        .issue();
+}
+
+TESTA_DEF_VERIFY_WITH_TB(GcdInputIndex, gcd_tb, input_index_verifier, gcd);
+TESTA_DEF_VERIFY_WITH_INDEXED_TB(IndexedGcdInputIndex, 13 * 13, gcd_input, input_index_verifier, gcd);
+
+size_t count_words(string_view s)
+{
+    size_t n = 0;
+    for(size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != ' ' && (i == 0 || s[i - 1] == ' ')) {
+            ++n;
+        }
+    }
+    return n;
+}
+
+size_t count_words_oracle(string_view s)
+{
+    size_t n = 0;
+    bool inWord = false;
+    for(char c: s) {
+        n += (c != ' ' && !inWord);
+        inWord = (c != ' ');
+    }
+    return n;
+}
+
+void count_words_verifier(const size_t& res, string_view s)
+{
+    TESTA_ASSERT(res <= size_t(count(s.begin(), s.end(), ' ')) + 1)
+        .hint("res={}", res)
+        .issue();
+}
+
+void corpus_correct(const string&)
+{
+    const vector<string> records{"", "a", "two words", string(100000, ' '), string(3, '\0')};
+    string path = "/tmp/testa_corpus_correct." + to_string(getpid());
+    {
+        testa::CorpusWriter writer(path);
+        for(int i = 0; i < 1000; ++i) {
+            writer.add(records[i % records.size()]);
+        }
+        writer.close();
+    }
+    testa::Corpus corpus(path);
+    TESTA_ASSERT(corpus.size() == 1000)
+        .hint("size={}", corpus.size())
+        .issue();
+    for(size_t i = 0; i < corpus.size(); ++i) {
+        TESTA_ASSERT(corpus[i] == records[i % records.size()])
+            .hint("index={}", i)
+            .issue();
+    }
+    testa::_impl::EqCase::with_corpus(path.c_str(), &count_words, &count_words_oracle);
+    remove(path.c_str());
+}
+TESTA_DEF_JUNIT_LIKE1(corpus_correct);
+
+// fails, since its corpus is absent, both by itself and as a missing dependency in runtests.py.
+TESTA_DEF_VERIFY_WITH_CORPUS(WrongMissingCorpus, "data/missing.corpus", count_words_verifier, count_words);
+
+int multiply2_trial(int a, int b)
+{
+    return a * b;
+}
+
+int multiply2_oracle(int a, int b)
+{
+    return multiply_oracle(make_tuple(a, b));
+}
+
+auto permutation2_tb = [](const string& name, const auto& cs) {
+    for(int i = 1; i <= 5; ++i) {
+        for(int j = 1; j <= 5; ++j) {
+            cs(i, j);
+        }
+    }
+};
+
+TESTA_DEF_EQ_WITH_TB(CorrectMultiple2, permutation2_tb, multiply2_trial, multiply2_oracle);
+TESTA_DEF_EQ_WITH_TB(LambdaCorrectMultiple2, permutation2_tb,
+    [](int a, int b) { return b * a; },
+    multiply2_oracle);
+TESTA_DEF_EQ_WITH_TB(LambdaWrongMultiple2, permutation2_tb,
+    [](int a, int b) { return a + b; },
+    multiply2_oracle);
+
+int sum4(int a, int b, int c, int d)
+{
+    return a + b + c + d;
+}
+
+int sum4_oracle(int a, int b, int c, int d)
+{
+    return d + c + b + a;
+}
+
+int sum3_of4(int a, int b, int c, int d)
+{
+    return a + b + c;
+}
+
+TESTA_DEF_EQ(Eq4, sum4, sum4_oracle, 1, 2, 3, 4);
+TESTA_DEF_EQ(WrongEq4, sum3_of4, sum4_oracle, 1, 2, 3, 4);
+
+// Inputs are non-const globals, so they are not folded into constants.
+int bench_gcd_a = 1071;
+int bench_gcd_b = 462;
+
+TESTA_DEF_BENCH(BenchGcd, []() { return gcd(make_tuple(bench_gcd_a, bench_gcd_b)); });
+
+int slow_multiply(int a, int b)
+{
+    int r = 0;
+    for(int i = 0; i < b; ++i) {
+        r += a;
+        testa::do_not_optimize(r);
+    }
+    return r;
+}
+
+// As fast as slow_multiply, unless b is large.
+int hybrid_multiply(int a, int b)
+{
+    return (b >= 1000) ? a * b : slow_multiply(a, b);
+}
+
+auto magnitude_tb = [](const string& name, const auto& cs) {
+    for(int i = 1; i <= 100; ++i) {
+        cs(i, 100 + i);
+        cs(i, 2000 + i);
+    }
+};
+
+const char* magnitude(int a, int b)
+{
+    return (b >= 1000) ? "large" : "small";
+}
+
+TESTA_DEF_EQ_FASTER_WITH_TB(FasterMultiply, magnitude_tb, multiply2_trial, slow_multiply, 2);
+TESTA_DEF_EQ_FASTER_WITH_TB(FasterHybridMultiply, magnitude_tb, hybrid_multiply, slow_multiply, 2);
+TESTA_DEF_EQ_FASTER_WITH_TB(WrongFasterMultiply, magnitude_tb, slow_multiply, multiply2_trial, 2);
+TESTA_DEF_EQ_FASTER_BY_CLASS_WITH_TB(FasterMultiplyByClass, magnitude_tb,
+    multiply2_trial, slow_multiply, 2, magnitude);
+TESTA_DEF_EQ_FASTER_BY_CLASS_WITH_TB(WrongFasterHybridMultiplyByClass, magnitude_tb,
+    hybrid_multiply, slow_multiply, 2, magnitude);
+
+TESTA_DEF_EQ_LATENCY_WITH_TB(LatencyMultiply, permutation_tb, multiply_trial, multiply_oracle,
+    .p50 = 1000000, .p999 = 10000000);
+TESTA_DEF_EQ_LATENCY_WITH_TB(WrongLatencyMultiply, permutation_tb, multiply_trial, multiply_oracle,
+    .max = 1);
+TESTA_DEF_VERIFY_LATENCY_WITH_TB(LatencyGcd, gcd_tb, gcd_verifier, gcd, .p99 = 10000000);
+
+string repeat_trial(const string& s, int n)
+{
+    string r;
+    r.reserve(s.size() * n);
+    for(int i = 0; i < n; ++i) {
+        r += s;
+    }
+    return r;
+}
+
+string repeat_oracle(const string& s, int n)
+{
+    return (n == 0) ? string() : repeat_oracle(s, n - 1) + s;
+}
+
+auto repeat_tb = [](const string& name, const auto& cs) {
+    for(const char* s: {"", "a", "ab", "abc"}) {
+        for(int n = 0; n <= 5; ++n) {
+            cs(string(s), n);
+        }
+    }
+};
+
+TESTA_DEF_EQ_GOLDEN_WITH_TB(GoldenMultiply, permutation2_tb, multiply2_trial, multiply2_oracle);
+TESTA_DEF_EQ_GOLDEN_WITH_TB(GoldenRepeat, repeat_tb, repeat_trial, repeat_oracle);
+TESTA_DEF_EQ_GOLDEN_WITH_TB(WrongGoldenMultiply, permutation2_tb,
+    [](int a, int b) { return a + b; },
+    multiply2_oracle);
+
+TESTA_DEF_FUZZ(FuzzMultiply, multiply2_trial, multiply2_oracle, int, unsigned char);
+// slow_multiply is wrong on negative `b`.
+TESTA_DEF_FUZZ(WrongFuzzMultiply, multiply2_trial, slow_multiply, int, signed char);
+TESTA_DEF_FUZZ(FuzzCountWords, count_words, count_words_oracle, string);
+
+TESTA_DEF_EQ_WITH_TB(RandomCountWords, (testa::random_tb<string>), count_words, count_words_oracle);
+TESTA_DEF_EQ_WITH_INDEXED_TB(IndexedRandomCountWords, 100000, (testa::random_input<string>),
+    count_words, count_words_oracle);
+// Shrunk into (0, 1) or (1, 0).
+TESTA_DEF_EQ_WITH_TB(WrongRandomAdd, (testa::random_tb<tuple<int, int>>), add_trial, multiply_trial);
+
+long sum_present(const vector<optional<int>>& xs)
+{
+    long res = 0;
+    for(const auto& x: xs) {
+        if (x) {
+            res += *x;
+        }
+    }
+    return res;
+}
+
+long sum_present_oracle(const vector<optional<int>>& xs)
+{
+    return accumulate(xs.begin(), xs.end(), 0L, [](long acc, const optional<int>& x) {
+        return acc + x.value_or(0);
+    });
+}
+
+TESTA_DEF_EQ_WITH_PAR_TB(RandomSumPresent, (testa::random_tb<vector<optional<int>>>),
+    sum_present, sum_present_oracle);
+
+void add_batch(span<const int> as, span<const int> bs, span<int> out)
+{
+    for(size_t i = 0; i < out.size(); ++i) {
+        out[i] = as[i] + bs[i];
+    }
+}
+
+void multiply_batch(span<const int> as, span<const int> bs, span<int> out)
+{
+    for(size_t i = 0; i < out.size(); ++i) {
+        out[i] = as[i] * bs[i];
+    }
+}
+
+void add_batch_oracle(span<const int> as, span<const int> bs, span<int> out)
+{
+    for(size_t i = 0; i < out.size(); ++i) {
+        out[i] = add_trial(make_tuple(as[i], bs[i]));
+    }
+}
+
+void count_words_batch(span<const string> xs, span<size_t> out)
+{
+    transform(xs.begin(), xs.end(), out.begin(), count_words);
+}
+
+void count_words_batch_oracle(span<const string> xs, span<size_t> out)
+{
+    transform(xs.begin(), xs.end(), out.begin(), count_words_oracle);
+}
+
+TESTA_DEF_EQ_BATCH_WITH_TB(BatchAdd, (testa::random_tb<tuple<int, int>>), add_batch, add_batch_oracle, int);
+TESTA_DEF_EQ_BATCH_WITH_TB(WrongBatchAdd, permutation_tb, multiply_batch, add_batch_oracle, int);
+TESTA_DEF_EQ_BATCH_WITH_TB(BatchCountWords, (testa::random_tb<string>),
+    count_words_batch, count_words_batch_oracle, size_t);
+
+void shrink_correct(const string&)
+{
+    auto cs = testa::_impl::EqCheck{TESTA_IMPL_FN(add_trial), TESTA_IMPL_FN(multiply_trial)};
+    string msg;
+    try {
+        testa::random_tb<tuple<int, int>>("", cs);
+    } catch (const logic_error& ex) {
+        msg = ex.what();
+    }
+    TESTA_ASSERT(msg.find("input=(0, 1)") != string::npos || msg.find("input=(1, 0)") != string::npos)
+        .hint("msg={}", msg)
+        .issue();
+}
+TESTA_DEF_JUNIT_LIKE1(shrink_correct);
+
+struct alignas(64) PaddedCounter {
+    uint64_t n = 0;
+};
+
+PaddedCounter per_thread_counters[256];
+
+void count_per_thread(size_t tid)
+{
+    ++per_thread_counters[tid % 256].n;
+}
+
+// Efficiency never exceeds 100%, not even at a single thread.
+TESTA_DEF_SCALING(ScalingPerThreadCounter, count_per_thread, 8, 0.5);
+TESTA_DEF_SCALING(WrongScalingPerThreadCounter, count_per_thread, 8, 1.5);
+
+#ifdef TESTA_COUNT_ALLOCS
+
+int multiply_by_vector(int a, int b)
+{
+    vector<int> v{a, b};
+    testa::do_not_optimize(v.data());
+    return v[0] * v[1];
+}
+
+TESTA_DEF_EQ_ALLOC_BUDGET_WITH_TB(AllocFreeMultiply, permutation2_tb, multiply2_trial, multiply2_oracle, 0);
+TESTA_DEF_EQ_ALLOC_BUDGET_WITH_TB(WrongAllocFreeMultiply, permutation2_tb, multiply_by_vector, multiply2_oracle, 0);
+TESTA_DEF_VERIFY_ALLOC_BUDGET_WITH_TB(AllocFreeGcd, gcd_tb, gcd_verifier, gcd, 0);
+
+void alloc_scope_correct(const string&)
+{
+    testa::AllocScope scope;
+    vector<int> v(1000);
+    testa::AllocCounters cnt = scope.counters();
+    TESTA_ASSERT(cnt.allocs == 1 && cnt.peak >= 4000)
+        .hint("allocs={}", cnt.allocs)
+        .hint("peak={}", cnt.peak)
+        .issue();
+}
+TESTA_DEF_JUNIT_LIKE1(alloc_scope_correct);
+
+#endif
@@ -30,13 +30,22 @@
 # SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 import argparse
+import ctypes
+import fcntl
+import hashlib
 import json
 import os
 import re
+import select
+import signal
+import struct
 import subprocess as sp
 import shlex
+import shutil
+import socket
 import sys
 import threading
+from contextlib import contextmanager
 from datetime import datetime, timedelta, UTC
 from math import sqrt, fabs
 from pathlib import Path
@@ -65,11 +74,55 @@ def parseArgs():
                         help='A regular expression. Test cases matching this pattern will not be run. [default: "^$"]')
     parser.add_argument('--timeout', nargs='?', type=int,
                         help='how long a case is allowed to run (in sec) [default: disable]')
+    parser.add_argument('--adaptive-timeout', nargs='?', type=float, metavar='K',
+                        help='how long a case is allowed to run is average + K stddev of its durations in stats.json, within [--min-timeout, --timeout]. Cases of less than 2 durations fall back to --timeout [default: disable]')
+    parser.add_argument('--fail-fast', dest='fail_fast', action='store_const', const=1,
+                        help='stop once a case fails, cancelling cases queued and killing those running, i.e., --max-failures 1')
+    parser.add_argument('--max-failures', dest='fail_fast', type=int, metavar='N',
+                        help='stop once N cases fail, cancelling cases queued and killing those running [default: disable]')
+    parser.add_argument('--min-timeout', nargs='?', type=float, default=10,
+                        help='the least timeout (in sec) by --adaptive-timeout [default: 10]')
     parser.add_argument('--report', nargs='?',
                         help='report as a json file')
+    parser.add_argument('--batch-pure', action='store_true',
+                        help='run pure cases of each C++ executable by a thread pool inside a single process')
+    parser.add_argument('--force', action='store_true',
+                        help='run all cases, even those passed before with the same executables and data dependencies')
+    parser.add_argument('--no-discovery-cache', dest='discovery_cache', action='store_false',
+                        help='always list cases afresh, rather than reusing those listed for identical executables')
+    parser.add_argument('--mem-budget', nargs='?', type=int,
+                        help='how much memory (in MB) cases can take at the same time, estimated by their max RSS in history [default: unlimited]')
+    parser.add_argument('--perf', action='store_true',
+                        help='count instructions, cycles and etc. of C++ cases by perf_event_open, which are kept in the report and stats.json')
+    parser.add_argument('--serve', action='store_true',
+                        help='run cases of C++ executables through their `--serve` mode, which forks a child per case from a single initialized process')
+    parser.add_argument('--record-coverage', action='store_true',
+                        help='run all cases, each in a process of its own, and index source files they cover by gcov into coverage.json. Executables must be built with `--coverage`.')
+    parser.add_argument('--changed', nargs='+', metavar='FILE',
+                        help='run only cases covering any of these source files in coverage.json, and cases not indexed yet')
+    parser.add_argument('--golden-dir', nargs='?',
+                        help='where C++ cases of TESTA_DEF_EQ_GOLDEN_WITH_TB persist results of their oracles [default: disable]')
+    parser.add_argument('--regenerate-golden', action='store_true',
+                        help='run all cases, and rebuild golden files from their oracles')
+    parser.add_argument('--sandbox-smoke', action='store_true',
+                        help='run each smoke case in Linux namespaces of its own by `unshare`, so smoke cases run in parallel without interfering: a private /tmp and a copy-on-write overlay of its working directory, both on tmpfs, a network of its own loopback, and a pid namespace')
+    parser.add_argument('--per-case-files', action='store_true',
+                        help='put stdout and stderr of each case into files of its own, DIR/EXECUTABLE/CASE.out and .err, rather than into segment files under DIR/segments/')
     args = parser.parse_args()
+    if args.record_coverage:
+        # counters of gcov are per process and accumulated across runs.
+        args.serve = False
+        args.batch_pure = False
+        args.force = True
+    if args.golden_dir is not None:
+        # inherited by all executables and case servers
+        os.environ['TESTA_GOLDEN_DIR'] = str(Path(args.golden_dir).absolute())
+    if args.regenerate_golden:
+        os.environ['TESTA_GOLDEN_REGENERATE'] = '1'
+        args.force = True
     args.dir = Path(args.dir).absolute()
     args.stats = readStats(args)
+    args.outputs = None if args.per_case_files else OutputStore(args.dir)
     return args
 
 def readLangCfg(fn):
@@ -98,8 +151,454 @@ kSkip = 'Skip'
 
 gCancelled = False
 
-def work(opts, qin, qout):
+class RunningGroups:
+    """Process groups of cases running, which are killed on cancellation."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.pgids = set()
+
+    def add(self, pgid):
+        with self.lock:
+            # A case started right after cancellation is killed at once.
+            if gCancelled:
+                killGroup(pgid)
+            self.pgids.add(pgid)
+
+    def remove(self, pgid):
+        with self.lock:
+            self.pgids.discard(pgid)
+
+    def cancel(self):
+        """Stop workers from taking more cases, and kill cases running."""
+        global gCancelled
+        with self.lock:
+            gCancelled = True
+            for pgid in self.pgids:
+                killGroup(pgid)
+
+gRunning = RunningGroups()
+
+class LineReader:
+    """Read lines from a pipe with an optional deadline."""
+
+    def __init__(self, fd):
+        self.fd = fd
+        self.buf = b''
+
+    def readline(self, deadline=None):
+        while b'\n' not in self.buf:
+            timeout = None
+            if deadline is not None:
+                timeout = (deadline - datetime.now(UTC)).total_seconds()
+                if timeout <= 0:
+                    raise sp.TimeoutExpired('', 0)
+            ready, _, _ = select.select([self.fd], [], [], timeout)
+            if not ready:
+                continue
+            data = os.read(self.fd, 4096)
+            if not data:
+                raise EOFError('pipe is closed unexpectedly')
+            self.buf += data
+        line, self.buf = self.buf.split(b'\n', 1)
+        return line.decode()
+
+class CaseServer:
+    """A process in `--serve` mode, which forks a child for each case."""
+
+    def __init__(self, args, cwd):
+        self.proc = sp.Popen(args, stdin=sp.PIPE, stdout=sp.PIPE, cwd=cwd, bufsize=0)
+        self.reader = LineReader(self.proc.stdout.fileno())
+
+    def readline(self, deadline=None):
+        return self.reader.readline(deadline).split()
+
+    def run(self, name, stdout, stderr, timeout):
+        """Run a case and return its exit code, negative for signals like `subprocess`,
+        and its resource usage, or None if the server does not tell."""
+        self.proc.stdin.write(f'{name}\t{stdout}\t{stderr}\n'.encode())
+        started = self.readline()
+        assert started[0] == 'started', started
+        pid = int(started[1])
+        deadline = None
+        if timeout:
+            deadline = datetime.now(UTC) + timedelta(seconds=timeout)
+        gRunning.add(pid)
+        try:
+            res = self.readline(deadline)
+        except sp.TimeoutExpired:
+            killGroup(pid)
+            self.readline()
+            raise
+        finally:
+            gRunning.remove(pid)
+        usage = None
+        if len(res) >= 9:
+            usage = usageDict(*(int(x) for x in res[2:9]))
+        if res[0] == 'signaled':
+            return -int(res[1]), usage
+        assert res[0] == 'exited', res
+        return int(res[1]), usage
+
+    def close(self):
+        try:
+            self.proc.stdin.close()
+        except OSError:
+            pass
+        self.proc.wait()
+
+def runServed(opts, servers, cs, stdout, stderr, timeout):
+    key = (cs['serve'], str(cs['cwd']))
+    server = servers.get(key)
+    if server is None or server.proc.poll() is not None:
+        server = CaseServer(shlex.split(cs['serve']), cs['cwd'])
+        servers[key] = server
+    try:
+        return server.run(cs['casename'], stdout, stderr, timeout)
+    except (EOFError, BrokenPipeError):
+        del servers[key]
+        server.close()
+        raise
+
+def usageDict(maxrss, utime, stime, minflt, majflt, nvcsw, nivcsw):
+    """Resource usage of a case. Max RSS is in KB, and cpu times are in microseconds."""
+    return {
+        'maxrss': maxrss,
+        'utime': utime,
+        'stime': stime,
+        'minflt': minflt,
+        'majflt': majflt,
+        'nvcsw': nvcsw,
+        'nivcsw': nivcsw,
+    }
+
+def killGroup(pid):
+    """Kill a process leading a process group, along with all processes in the group."""
+    try:
+        os.killpg(pid, signal.SIGKILL)
+    except ProcessLookupError:
+        pass
+
+def runWithUsage(args, cwd, stdout, stderr, timeout, env=None):
+    """Run a process in a process group of its own, and reap it by wait4.
+    On timeout, the whole group is killed, so children of the process do not outlive it.
+    Return its exit code, its resource usage and whether it is killed for timeout."""
+    proc = sp.Popen(args, cwd=cwd, stdout=stdout, stderr=stderr, env=env, process_group=0)
+    gRunning.add(proc.pid)
+    timedOut = threading.Event()
+    def kill():
+        timedOut.set()
+        killGroup(proc.pid)
+    timer = None
+    if timeout:
+        timer = threading.Timer(timeout, kill)
+        timer.start()
+    try:
+        while True:
+            try:
+                _, status, ru = os.wait4(proc.pid, 0)
+                break
+            except InterruptedError:
+                pass
+    finally:
+        if timer is not None:
+            timer.cancel()
+        gRunning.remove(proc.pid)
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    usage = usageDict(ru.ru_maxrss,
+        int(ru.ru_utime * 1e6), int(ru.ru_stime * 1e6),
+        ru.ru_minflt, ru.ru_majflt, ru.ru_nvcsw, ru.ru_nivcsw)
+    return proc.returncode, usage, timedOut.is_set()
+
+def coveredFiles(gcovDir):
+    """Source files with any line executed, according to gcda files under `gcovDir`,
+    which is GCOV_PREFIX of a run. Return None if there is no gcda file."""
+    gcdas = sorted(gcovDir.rglob('*.gcda'))
+    if not gcdas:
+        return None
+    for gcda in gcdas:
+        # gcno files are beside the original gcda files.
+        gcno = Path('/') / gcda.relative_to(gcovDir).with_suffix('.gcno')
+        link = gcda.with_suffix('.gcno')
+        if gcno.exists() and not link.exists():
+            link.symlink_to(gcno)
+    try:
+        out = sp.run(['gcov', '--stdout', '--json-format'] + [str(x) for x in gcdas],
+            cwd=gcovDir, stdout=sp.PIPE, stderr=sp.DEVNULL, check=True).stdout
+    except (OSError, sp.CalledProcessError):
+        return None
+    res = set()
+    for line in out.splitlines():
+        if not line.strip():
+            continue
+        unit = json.loads(line)
+        cwd = unit.get('current_working_directory', '/')
+        for f in unit.get('files', []):
+            if any(x['count'] > 0 for x in f.get('lines', [])):
+                res.add(os.path.normpath(os.path.join(cwd, f['file'])))
+    return sorted(res)
+
+class CoverageIndex:
+    """Source files covered by each case, kept in coverage.json.
+    Files are stored once, and cases refer to them by indices."""
+
+    def __init__(self, opts):
+        self.fn = opts.dir / 'coverage.json'
+        self.cases = {}
+        if self.fn.exists():
+            with open(self.fn) as fp:
+                x = json.load(fp)
+            files = x['files']
+            self.cases = {k: set(files[i] for i in v) for k, v in x['cases'].items()}
+
+    def update(self, results):
+        for r in results:
+            cov = r.pop('coverage', None)
+            if cov is not None:
+                self.cases[r['name']] = set(cov)
+
+    def affected(self, cases, changed):
+        """Cases covering any of changed files, and those not indexed."""
+        changed = set(os.path.abspath(x) for x in changed)
+        res = []
+        for cs in cases:
+            cov = self.cases.get(cs['name'])
+            if cov is None or cov & changed:
+                res.append(cs)
+        return res
+
+    def save(self):
+        files = sorted(set().union(*self.cases.values())) if self.cases else []
+        idx = {f: i for i, f in enumerate(files)}
+        with open(self.fn, 'w') as fp:
+            json.dump({
+                'files': files,
+                'cases': {k: sorted(idx[f] for f in v) for k, v in self.cases.items()},
+            }, fp, sort_keys=True)
+
+class MemoryGate:
+    """Admit cases while their estimated max RSS in total is within a budget.
+    A case larger than the budget is admitted only when nothing else runs."""
+
+    def __init__(self, budget):
+        self.budget = budget
+        self.used = 0
+        self.cond = threading.Condition()
+
+    def acquire(self, size):
+        with self.cond:
+            self.cond.wait_for(lambda: self.used == 0 or self.used + size <= self.budget)
+            self.used += size
+
+    def release(self, size):
+        with self.cond:
+            self.used -= size
+            self.cond.notify_all()
+
+class SlotGate:
+    """Admit cases while threads they take in total are within `--jobs` slots.
+    A case takes a slot, a batch of pure cases as many as its threads,
+    and a functional case all of them, so it runs when nothing else does, since it takes the whole environment.
+    Cases of a single slot wait while a larger one is waiting, so it is not starved."""
+
+    def __init__(self, slots):
+        self.slots = max(slots, 1)
+        self.used = 0
+        self.waiting = 0
+        self.cond = threading.Condition()
+
+    def acquire(self, n):
+        n = min(n, self.slots)
+        with self.cond:
+            if n > 1:
+                self.waiting += 1
+                self.cond.wait_for(lambda: self.used + n <= self.slots)
+                self.waiting -= 1
+            else:
+                self.cond.wait_for(lambda: self.waiting == 0 and self.used + n <= self.slots)
+            self.used += n
+        return n
+
+    def release(self, n):
+        with self.cond:
+            self.used -= n
+            self.cond.notify_all()
+
+def slotsOf(opts, cs):
+    """How many of `--jobs` slots a case takes."""
+    if cs.get('isolation') == 'functional':
+        return opts.jobs
+    return cs.get('threads', 1)
+
+def estimateMemory(opts, case_name):
+    """Peak of max RSS (in KB) of a case in history, or a fair share of the budget if unknown."""
+    hist = opts.stats.get(f'{case_name}#maxrss')
+    if hist:
+        return max(hist)
+    return opts.mem_budget * 1024 // max(opts.jobs, 1)
+
+def parseLocation(loc):
+    """Split "PATH@OFFSET+LENGTH", where a case's output is in a segment file.
+    A location of a plain path is the whole file."""
+    m = re.fullmatch(r'(.*)@(\d+)\+(\d+)', str(loc))
+    if m is None:
+        return Path(loc), 0, None
+    return Path(m[1]), int(m[2]), int(m[3])
+
+def readOutput(loc):
+    fn, offset, length = parseLocation(loc)
+    with open(fn, 'rb') as fp:
+        fp.seek(offset)
+        return fp.read() if length is None else fp.read(length)
+
+class PerCaseFiles:
+    """Output of each case is put into files of its own, at `stdout` and `stderr` of the case."""
+
+    @contextmanager
+    def open(self, cs):
+        with open(cs['stdout'], 'wb') as stdout, open(cs['stderr'], 'wb') as stderr:
+            yield stdout, stderr
+
+    def put(self, cs, out, err):
+        with self.open(cs) as (stdout, stderr):
+            stdout.write(out)
+            stderr.write(err)
+
+    def close(self):
+        pass
+
+class SegmentWriter(PerCaseFiles):
+    """A pair of segment files of a worker, which cases run by the worker append their output to.
+    After a case, its `stdout` and `stderr` are set to where its output is.
+    Requests of listing cases, which have no `casename`, are still put into files of their own."""
+
+    def __init__(self, prefix):
+        self.stdout = open(f'{prefix}.out', 'ab', buffering=0)
+        self.stderr = open(f'{prefix}.err', 'ab', buffering=0)
+
+    @contextmanager
+    def open(self, cs):
+        if 'casename' not in cs:
+            with super().open(cs) as files:
+                yield files
+            return
+        # Cases write through file descriptors of their own, so offsets are taken from sizes.
+        starts = [os.fstat(fp.fileno()).st_size for fp in (self.stdout, self.stderr)]
+        try:
+            yield self.stdout, self.stderr
+        finally:
+            for k, fp, start in zip(['stdout', 'stderr'], [self.stdout, self.stderr], starts):
+                size = os.fstat(fp.fileno()).st_size
+                cs[k] = f'{fp.name}@{start}+{size - start}'
+
+    def close(self):
+        self.stdout.close()
+        self.stderr.close()
+
+class OutputStore:
+    """Output of cases in segment files under `DIR/segments/`,
+    a pair of segment files per worker and run, rather than a pair of files per case.
+    `index.json` there maps each case to where its latest output is,
+    as "SEGMENT@OFFSET+LENGTH" relative to the directory.
+    Segment files no longer referenced by the index are removed after each run."""
+
+    def __init__(self, testDir):
+        self.dir = testDir / 'segments'
+        self.dir.mkdir(parents=True, exist_ok=True)
+        self.run = f'{datetime.now(UTC):%Y%m%d%H%M%S}-{os.getpid()}'
+        self.lock = threading.Lock()
+        self.workers = 0
+        self.index = {}
+        fn = self.dir / 'index.json'
+        if fn.exists():
+            with open(fn) as fp:
+                self.index = json.load(fp)
+
+    def writer(self):
+        with self.lock:
+            n = self.workers
+            self.workers += 1
+        return SegmentWriter(self.dir / f'{self.run}-{n}')
+
+    def locate(self, name):
+        """Absolute locations of stdout and stderr of a case, or None if it is not indexed."""
+        locs = self.index.get(name)
+        if locs is None:
+            return None
+        return {k: str(self.dir / v) for k, v in locs.items()}
+
+    def update(self, results):
+        for r in results:
+            if 'casename' not in r or 'stdout' not in r:
+                continue
+            self.index[r['name']] = {
+                k: str(Path(r[k]).relative_to(self.dir)) for k in ['stdout', 'stderr']}
+
+    def save(self):
+        with open(self.dir / 'index.json', 'w') as fp:
+            json.dump(self.index, fp, sort_keys=True)
+        used = {parseLocation(v)[0].name for locs in self.index.values() for v in locs.values()}
+        for fn in self.dir.iterdir():
+            if fn.suffix in ('.out', '.err') and fn.name not in used:
+                fn.unlink()
+
+def caseOutput(opts):
+    if opts.outputs is None:
+        return PerCaseFiles()
+    return opts.outputs.writer()
+
+def runBatch(opts, output, batch, qin, qout):
+    """Run pure cases of an executable by a thread pool inside a single process."""
+    cases = {c['casename']: c for c in batch['batch']}
+    threads = batch['threads']
+    # Cases run in any order, by `threads` at a time,
+    # so the whole batch is bounded by rounds of the longest timeout.
+    timeout = None
+    timeouts = [caseTimeout(opts, x['name']) for x in cases.values()]
+    if all(timeouts):
+        timeout = max(timeouts) * -(-len(cases) // threads)
+    start = datetime.now(UTC)
+    deadline = start + timedelta(seconds=timeout) if timeout else None
+    with open(batch['stderr'], 'wb') as stderr:
+        proc = sp.Popen(shlex.split(batch['execute']),
+            stdin=sp.PIPE, stdout=sp.PIPE, stderr=stderr,
+            cwd=batch['cwd'], bufsize=0, process_group=0,
+            env=dict(os.environ, TESTA_THREADS=str(threads)))
+        gRunning.add(proc.pid)
+        try:
+            proc.stdin.write(''.join(f'{x}\n' for x in cases).encode())
+            proc.stdin.close()
+            reader = LineReader(proc.stdout.fileno())
+            while cases:
+                res = json.loads(reader.readline(deadline))
+                cs = cases.pop(res['name'])
+                output.put(cs, res.get('output', '').encode(), res['message'].encode())
+                cs['stop'] = datetime.now(UTC)
+                cs['start'] = cs['stop'] - timedelta(seconds=res['duration'])
+                qout.put([kOk if res['result'] == 'PASS' else kError, cs['name'], cs])
+        except sp.TimeoutExpired:
+            killGroup(proc.pid)
+            for cs in cases.values():
+                cs['start'] = start
+                cs['stop'] = datetime.now(UTC)
+                cs['timeout'] = timeout
+                qout.put([kTimeout, cs['name'], cs])
+            cases = {}
+        except (EOFError, BrokenPipeError):
+            pass
+        finally:
+            if cases and proc.poll() is None:
+                killGroup(proc.pid)
+            proc.wait()
+            gRunning.remove(proc.pid)
+    # The process crashes. Remaining cases fall back to one process per case.
+    for cs in cases.values():
+        qin.put(cs)
+
+def work(opts, qin, qout, gate, slots):
     global gCancelled
+    servers = {}
+    output = caseOutput(opts)
     try:
         while True:
             cs = qin.get()
@@ -107,43 +606,106 @@ def work(opts, qin, qout):
                 break
             if gCancelled:
                 break
-            args = shlex.split(cs['execute'])
-            kws = {}
-            with open(cs['stdout'], 'wb') as stdout, open(cs['stderr'], 'wb') as stderr:
-                if cs.get('broken', False):
-                    stdout.write(cs['broken-reason'].encode())
-                    qout.put([kSkip, cs['name'], cs])
+            mem = 0
+            if gate is not None and not cs.get('broken', False) and 'missing-deps' not in cs:
+                mem = estimateMemory(opts, cs['name'])
+                gate.acquire(mem)
+            n = slots.acquire(slotsOf(opts, cs))
+            try:
+                if gCancelled:
                     break
-                kws['stdout'] = stdout
-                kws['stderr'] = stderr
-                kws['check'] = True
-                kws['cwd'] = cs['cwd']
-                if opts.timeout and not cs.get('suppress_timeout', False):
-                    kws['timeout'] = opts.timeout
-                cs['start'] = datetime.now(UTC)
-                try:
-                    sp.run(args, **kws)
-                    cs['stop'] = datetime.now(UTC)
-                    qout.put([kOk, cs['name'], cs])
-                except sp.CalledProcessError:
-                    stderr.write(bytes(str(args), 'UTF-8'))
-                    stderr.write(bytes('\n', 'UTF-8'))
-                    stderr.write(bytes(str(kws), 'UTF-8'))
-                    stderr.write(bytes('\n', 'UTF-8'))
-                    cs['stop'] = datetime.now(UTC)
-                    qout.put([kError, cs['name'], cs])
-                except sp.TimeoutExpired:
-                    cs['stop'] = datetime.now(UTC)
-                    qout.put([kTimeout, cs['name'], cs])
+                workOn(opts, servers, output, cs, qin, qout)
+            finally:
+                slots.release(n)
+                if gate is not None:
+                    gate.release(mem)
     except KeyboardInterrupt:
         qout.put([kCancel, 'Ctrl-C'])
     except Exception as ex:
         qout.put([kCancel, str(ex)])
+    finally:
+        for server in servers.values():
+            server.close()
+        output.close()
+
+def workOn(opts, servers, output, cs, qin, qout):
+    if 'batch' in cs:
+        runBatch(opts, output, cs, qin, qout)
+        return
+    args = shlex.split(cs['execute'])
+    kws = {}
+    # The result is put after output is closed, when `stdout` and `stderr` of the case are final.
+    with output.open(cs) as (stdout, stderr):
+        if cs.get('broken', False):
+            stdout.write(cs['broken-reason'].encode())
+            res = kSkip
+        elif 'missing-deps' in cs:
+            stderr.write(cs['missing-deps'].encode())
+            cs['start'] = cs['stop'] = datetime.now(UTC)
+            res = kError
+        else:
+            kws['stdout'] = stdout
+            kws['stderr'] = stderr
+            kws['check'] = True
+            kws['cwd'] = cs['cwd']
+            timeout = caseTimeout(opts, cs['name'])
+            if timeout and not cs.get('suppress_timeout', False):
+                kws['timeout'] = timeout
+                cs['timeout'] = timeout
+            res = runCase(opts, servers, cs, args, kws)
+    qout.put([res, cs['name'], cs])
+
+def runCase(opts, servers, cs, args, kws):
+    stdout = kws['stdout']
+    stderr = kws['stderr']
+    cs['start'] = datetime.now(UTC)
+    try:
+        if opts.serve and 'serve' in cs:
+            try:
+                code, usage = runServed(opts, servers, cs, stdout.name, stderr.name, kws.get('timeout'))
+            except EOFError:
+                code, usage = -signal.SIGKILL, None
+            stderr.seek(0, os.SEEK_END)
+        else:
+            env = None
+            if opts.record_coverage and 'casename' in cs:
+                gcovDir = opts.dir / 'gcov' / hashlib.sha1(cs['name'].encode()).hexdigest()
+                shutil.rmtree(gcovDir, ignore_errors=True)
+                env = dict(os.environ, GCOV_PREFIX=str(gcovDir), GCOV_PREFIX_STRIP='0')
+            try:
+                code, usage, timedOut = runWithUsage(args, cs['cwd'], stdout, stderr, kws.get('timeout'), env)
+            finally:
+                if env is not None:
+                    cs['coverage'] = coveredFiles(gcovDir)
+                    shutil.rmtree(gcovDir, ignore_errors=True)
+            if timedOut:
+                cs['rusage'] = usage
+                raise sp.TimeoutExpired(args, kws['timeout'])
+        if usage is not None:
+            cs['rusage'] = usage
+        if code != 0:
+            raise sp.CalledProcessError(code, args)
+        cs['stop'] = datetime.now(UTC)
+        return kOk
+    except sp.CalledProcessError:
+        stderr.write(bytes(str(args), 'UTF-8'))
+        stderr.write(bytes('\n', 'UTF-8'))
+        stderr.write(bytes(str(kws), 'UTF-8'))
+        stderr.write(bytes('\n', 'UTF-8'))
+        cs['stop'] = datetime.now(UTC)
+        return kError
+    except sp.TimeoutExpired:
+        cs['stop'] = datetime.now(UTC)
+        return kTimeout
 
 def launchWorkers(opts):
     reqQ = Queue()
     resQ = Queue()
-    workers = [threading.Thread(target=work, args=(opts, reqQ, resQ)) for _ in range(opts.jobs)]
+    gate = None
+    if opts.mem_budget:
+        gate = MemoryGate(opts.mem_budget * 1024)
+    slots = SlotGate(opts.jobs)
+    workers = [threading.Thread(target=work, args=(opts, reqQ, resQ, gate, slots)) for _ in range(opts.jobs)]
     for w in workers:
         w.start()
     return reqQ, resQ, workers
@@ -169,13 +731,148 @@ def getExecutableArgs(exe, langs):
     exe = Path(exe).absolute()
     return lang['execute'] % {'prog': exe, 'arg': '--show-cases'}
 
+def readElfSection(fn, secname):
+    """Content of a section in an ELF file, or None if either is absent."""
+    with open(fn, 'rb') as f:
+        ident = f.read(16)
+        if len(ident) < 16 or ident[:4] != b'\x7fELF':
+            return None
+        is64 = ident[4] == 2
+        endian = '<' if ident[5] == 1 else '>'
+        hdr = f.read(48 if is64 else 36)
+        if is64:
+            shoff, = struct.unpack_from(endian + 'Q', hdr, 0x28 - 16)
+            shentsize, shnum, shstrndx = struct.unpack_from(endian + 'HHH', hdr, 0x3A - 16)
+            shfmt = endian + 'IIQQQQ'
+        else:
+            shoff, = struct.unpack_from(endian + 'I', hdr, 0x20 - 16)
+            shentsize, shnum, shstrndx = struct.unpack_from(endian + 'HHH', hdr, 0x2E - 16)
+            shfmt = endian + 'IIIIII'
+        if shoff == 0:
+            return None
+        f.seek(shoff)
+        first = struct.unpack_from(shfmt, f.read(shentsize))
+        if shnum == 0:
+            shnum = first[5]
+        f.seek(shoff)
+        raw = f.read(shentsize * shnum)
+        sections = [struct.unpack_from(shfmt, raw, i * shentsize) for i in range(shnum)]
+        def content(sec):
+            if sec[1] == 8: # SHT_NOBITS
+                return b''
+            f.seek(sec[4])
+            return f.read(sec[5])
+        names = content(sections[shstrndx])
+        for sec in sections:
+            end = names.index(b'\0', sec[0])
+            if names[sec[0]:end].decode() == secname:
+                return content(sec)
+    return None
+
+def readManifest(exe):
+    """Cases embedded in section `testa_manifest` of a C++ executable, or None."""
+    try:
+        data = readElfSection(exe, 'testa_manifest')
+    except (OSError, ValueError, struct.error):
+        return None
+    if data is None:
+        return None
+    # besides cases, there are lines of their dependencies by TESTA_DEPS.
+    byName = {}
+    for line in data.split(b'\n'):
+        line = line.strip(b'\0')
+        if line:
+            c = json.loads(line)
+            byName.setdefault(c['name'], {}).update(c)
+    cases = [c for c in byName.values() if 'isolation' in c]
+    cases.sort(key=lambda x: x['name'])
+    return cases
+
+class DiscoveryCache:
+    """Listed cases of executables, keyed by content hashes of executables.
+
+    Hashes are reused as long as sizes and modification times of executables are unchanged,
+    so unchanged executables are neither launched nor read.
+    """
+
+    def __init__(self, opts):
+        self.fn = opts.dir / 'discovery.json'
+        self.enabled = opts.discovery_cache
+        self.files = {}
+        self.cases = {}
+        if self.enabled and self.fn.exists():
+            with open(self.fn) as fp:
+                x = json.load(fp)
+            self.files = x.get('files', {})
+            self.cases = x.get('cases', {})
+
+    def hash(self, fn):
+        """Content hash of a file, or of all files under a directory, or None if it is absent."""
+        path = Path(fn).absolute()
+        if path.is_dir():
+            h = hashlib.sha256()
+            for sub in sorted(path.rglob('*')):
+                if sub.is_file():
+                    h.update(str(sub.relative_to(path)).encode())
+                    h.update(self.hash(sub).encode())
+            return h.hexdigest()
+        try:
+            st = os.stat(path)
+        except OSError:
+            return None
+        path = str(path)
+        known = self.files.get(path)
+        if known is not None and known['size'] == st.st_size and known['mtime'] == st.st_mtime_ns:
+            return known['hash']
+        h = hashlib.sha256()
+        with open(path, 'rb') as fp:
+            for blk in iter(lambda: fp.read(1 << 20), b''):
+                h.update(blk)
+        digest = h.hexdigest()
+        self.files[path] = {'size': st.st_size, 'mtime': st.st_mtime_ns, 'hash': digest}
+        return digest
+
+    def key(self, exe, execute):
+        return f'{self.hash(exe)} {execute}'
+
+    def lookup(self, key):
+        if not self.enabled:
+            return None
+        return self.cases.get(key)
+
+    def store(self, key, cases):
+        self.cases[key] = cases
+
+    def save(self):
+        if not self.enabled:
+            return
+        self.files = {k: v for k, v in self.files.items() if Path(k).exists()}
+        live = set(v['hash'] for v in self.files.values())
+        self.cases = {k: v for k, v in self.cases.items() if k.split(' ', 1)[0] in live}
+        with open(self.fn, 'w') as fp:
+            json.dump({'files': self.files, 'cases': self.cases}, fp, sort_keys=True)
+
 def collectCases(opts, langs, reqQ, resQ):
+    cache = DiscoveryCache(opts)
+    found = {}
+    keys = {}
+    exeKeys = {}
     exes = []
     for exe in opts.executables:
         exeArgs = getExecutableArgs(exe, langs)
         progDir = Path(exe).parent
         testDir = (opts.dir / exe).absolute()
         testDir.mkdir(parents=True, exist_ok=True)
+        key = cache.key(exe, exeArgs)
+        exeKeys[exe] = key
+        cs = cache.lookup(key)
+        if cs is None and findMatchLanguage(exe, langs)['language'] is None:
+            cs = readManifest(exe)
+        if cs is not None:
+            cache.store(key, cs)
+            found[exe] = cs
+            continue
+        keys[exe] = key
         exes.append({
             'name': exe,
             'execute': exeArgs,
@@ -186,30 +883,106 @@ def collectCases(opts, langs, reqQ, resQ):
     for e in exes:
         reqQ.put(e)
 
-    cases = []
     for _ in range(len(exes)):
         res = resQ.get()
         assert res[0] == kOk, res
         exe = res[1]
         with open(res[2]['stdout']) as f:
             cs = json.load(f)
+        cache.store(keys[exe], cs)
+        found[exe] = cs
+
+    cases = []
+    for exe in opts.executables:
         lang = findMatchLanguage(exe, langs)
-        for c in cs:
+        native = lang['language'] is None
+        perf = '--perf ' if opts.perf and native else ''
+        for c in found[exe]:
             name = c['name']
             x = {
                 'name': f'{exe}/{name}',
+                'casename': name,
+                'isolation': c.get('isolation'),
                 'broken': c.get('broken', False),
                 'execute': lang['execute'] % \
-                    {'prog': Path(exe).absolute(), 'arg': name},
-                'cwd': res[2]['cwd'],
-                'stdout': opts.dir / exe / f'{name}.out',
-                'stderr': opts.dir / exe / f'{name}.err',
+                    {'prog': Path(exe).absolute(), 'arg': perf + name},
+                'cwd': Path(exe).parent,
             }
+            if opts.outputs is None:
+                x['stdout'] = opts.dir / exe / f'{name}.out'
+                x['stderr'] = opts.dir / exe / f'{name}.err'
             if x['broken']:
                 x['broken-reason'] = c['broken_reason']
+            deps = sorted(c.get('deps', []))
+            hashes = [[d, cache.hash(Path(exe).parent / d)] for d in deps]
+            missing = [d for d, h in hashes if h is None]
+            if missing:
+                # A case without its data fails, rather than being skipped as a pass.
+                x['missing-deps'] = f'missing data dependencies: {", ".join(missing)}\n'
+            x['cache-key'] = hashlib.sha256(json.dumps([
+                exeKeys[exe],
+                x['execute'],
+                hashes,
+            ]).encode()).hexdigest()
+            if native:
+                x['serve'] = lang['execute'] % \
+                    {'prog': Path(exe).absolute(), 'arg': perf + '--serve'}
+                x['run-pure'] = lang['execute'] % \
+                    {'prog': Path(exe).absolute(), 'arg': '--run-pure'}
+            if opts.sandbox_smoke and x['isolation'] == 'smoke':
+                # Children forked by a case server would share its namespaces.
+                x['execute'] = sandboxCommand(x['cwd']) + ' ' + x['execute']
+                x.pop('serve', None)
             cases.append(x)
+    cache.save()
     return cases
 
+class ResultCache:
+    """Keys of cases passed last time.
+    A key is a hash of the executable, the command line and data dependencies of a case."""
+
+    def __init__(self, opts):
+        self.fn = opts.dir / 'results.json'
+        self.passed = {}
+        if self.fn.exists():
+            with open(self.fn) as fp:
+                self.passed = json.load(fp)
+
+    def split(self, cases):
+        """Split cases into those cached and the rest."""
+        cached = []
+        rest = []
+        for cs in cases:
+            if not cs.get('broken', False) and 'missing-deps' not in cs \
+                    and self.passed.get(cs['name']) == cs.get('cache-key'):
+                cached.append(cs)
+            else:
+                rest.append(cs)
+        return cached, rest
+
+    def update(self, passed, failed):
+        for r in passed:
+            if r['result'] == 'PASS' and 'cache-key' in r:
+                self.passed[r['name']] = r['cache-key']
+        for r in failed:
+            self.passed.pop(r['name'], None)
+
+    def save(self):
+        with open(self.fn, 'w') as fp:
+            json.dump(self.passed, fp, sort_keys=True)
+
+def reportCached(opts, cached):
+    res = []
+    for cs in cached:
+        r = cs.copy()
+        if opts.outputs is not None:
+            r.update(opts.outputs.locate(r['name']) or {})
+        r['result'] = 'CACHED'
+        r['duration'] = timedelta()
+        res.append(r)
+        print('%s: %s passed before with the same executable and data' % (colored('cached', 'blue'), r['name']))
+    return res
+
 SUPPRESS_TERMCOLOR_DETECTION = False
 
 def colored(s, color):
@@ -233,12 +1006,85 @@ def filterCases(opts, cases):
     cases = [x for x in cases if re.search(opts.include, x['name'])]
     return cases
 
+def batchPureCases(opts, cases):
+    batches = {}
+    rest = []
+    for cs in cases:
+        if cs['isolation'] == 'pure' and 'run-pure' in cs and not cs['broken'] \
+                and 'missing-deps' not in cs:
+            batches.setdefault(cs['run-pure'], []).append(cs)
+        else:
+            rest.append(cs)
+    res = []
+    for cmd, xs in batches.items():
+        exe = xs[0]['name'][:-len(xs[0]['casename']) - 1]
+        res.append({
+            'name': f'{exe}/<pure>',
+            'batch': xs,
+            'execute': cmd,
+            'cwd': xs[0]['cwd'],
+            'stderr': opts.dir / exe / 'pure.err',
+            # as many threads as `--jobs`, each taking a slot.
+            'threads': max(opts.jobs, 1),
+        })
+    return res, rest
+
+def failureScore(opts, case_name):
+    """How likely a case fails, by its outcomes in history, 1 for failed and 0 for passed,
+    where each older outcome weighs half as much as the one after it.
+    So cases failed recently score the most, and flaky ones score more than stable ones."""
+    hist = opts.stats.get(f'{case_name}#failed', [])
+    return sum(x * 0.5 ** (len(hist) - 1 - i) for i, x in enumerate(hist))
+
 def dispatchCases(opts, cases, reqQ):
+    """Cases likely to fail run first, so failures are found early,
+    and then the longest ones, so the last to finish are short.
+    Functional cases run one at a time, so they come after all the others."""
     exp_rt = expectedRuntime(opts)
-    cases.sort(key=lambda c: exp_rt.get(c['name'], 0.0), reverse=True)
+    cases = sorted(cases,
+        key=lambda c: (c.get('isolation') != 'functional',
+            failureScore(opts, c['name']), exp_rt.get(c['name'], 0.0)),
+        reverse=True)
+    if opts.batch_pure:
+        batches, cases = batchPureCases(opts, cases)
+        for b in batches:
+            reqQ.put(b)
     for cs in cases:
         reqQ.put(cs)
 
+def readRecords(loc):
+    """Collect structured records, lines of "##testa:KIND JSON", written by a case."""
+    records = {}
+    try:
+        for line in readOutput(loc).splitlines():
+            if not line.startswith(b'##testa:'):
+                continue
+            kind, _, value = line[len(b'##testa:'):].decode(errors='replace').partition(' ')
+            try:
+                records.setdefault(kind, []).append(json.loads(value))
+            except json.JSONDecodeError:
+                pass
+    except OSError:
+        pass
+    return records
+
+# Counters of `--perf`, which are kept in stats.json under keys like "CASE#instructions".
+PERF_COUNTERS = ['instructions', 'cycles', 'branch_misses', 'cache_misses', 'task_clock']
+
+def perfMessage(opts, case_name, perf):
+    """Compare the most stable counter available against its history."""
+    for k in ['instructions', 'task_clock']:
+        if k not in perf:
+            continue
+        msg = f' ({k} {perf[k]}'
+        hist = opts.stats.get(f'{case_name}#{k}')
+        if hist:
+            avg = sum(hist) / float(len(hist))
+            if avg > 0:
+                msg += f', {(perf[k] - avg) / avg * 100:+.2f}% vs average'
+        return msg + ')'
+    return ''
+
 def collectResults(opts, cases, resQ):
     passed = []
     failed = []
@@ -256,6 +1102,9 @@ def collectResults(opts, cases, resQ):
             r['duration'] = res[2]['stop'] - res[2]['start']
             del r['start']
             del r['stop']
+            records = readRecords(r['stdout'])
+            if records:
+                r['records'] = records
             if res[0] == kOk:
                 r['result'] = 'PASS'
                 passed.append(r)
@@ -276,6 +1125,10 @@ def collectResults(opts, cases, resQ):
                         if hint is not None:
                             additional_msg = f'{additional_msg}{hint}'
                     additional_msg = f'({additional_msg})'
+                for p in records.get('perf', []):
+                    additional_msg += perfMessage(opts, r['name'], p)
+                for b in records.get('bench', []):
+                    additional_msg += ' (median {median:.3f} {unit}, mad {mad:.3f}, min {min:.3f})'.format(**b)
             elif res[0] == kError:
                 r['result'] = 'FAILED'
                 failed.append(r)
@@ -284,6 +1137,8 @@ def collectResults(opts, cases, resQ):
                 r['result'] = 'TIMEOUT'
                 failed.append(r)
                 result = colored('kill', 'red')
+                if 'timeout' in r:
+                    additional_msg = f' (timeout {r["timeout"]:.2f} secs)'
             else:
                 error('cancelled')
         print('%d/%d %s: %s costs %.3f secs%s' % (
@@ -292,6 +1147,10 @@ def collectResults(opts, cases, resQ):
             r['name'],
             r['duration'].total_seconds(),
             additional_msg))
+        if opts.fail_fast and len(failed) >= opts.fail_fast:
+            # Results of cases killed from now on are dropped.
+            gRunning.cancel()
+            break
     return passed, failed
 
 def report(filename, results):
@@ -302,7 +1161,22 @@ def report(filename, results):
         json_res.append(y)
     json_res.sort(key=lambda x:x['name'])
     with open(filename, 'w') as fp:
-        json.dump(json_res, fp, indent='  ', sort_keys=True)
+        json.dump(json_res, fp, indent='  ', sort_keys=True, default=str)
+
+def caseTimeout(opts, case_name):
+    """How long a case is allowed to run (in sec), or None if unlimited.
+    By `--adaptive-timeout K`, it is average + K stddev of durations of the case in history,
+    within [--min-timeout, --timeout]."""
+    if opts.adaptive_timeout is None:
+        return opts.timeout
+    avg_dev = calcAvgDev(opts, case_name)
+    if avg_dev is None:
+        return opts.timeout
+    avg, dev = avg_dev
+    timeout = max(avg + opts.adaptive_timeout * dev, opts.min_timeout)
+    if opts.timeout:
+        timeout = min(timeout, opts.timeout)
+    return timeout
 
 def calcAvgDev(opts, case_name):
     durs = opts.stats.get(case_name)
@@ -329,20 +1203,112 @@ def expectedRuntime(opts):
             res[k] = sum(v) / float(len(v))
     return res
 
+def appendStat(stats, key, value):
+    hist = stats.get(key, [])
+    hist.append(value)
+    if len(hist) > 10:
+        del hist[0 : len(hist) - 10]
+    stats[key] = hist
+
 def writeOutStats(opts, passed, failed):
     stats = opts.stats.copy()
+    for c in failed:
+        appendStat(stats, f"{c['name']}#failed", 1)
     for c in passed:
-        if c['result'] == 'SKIP':
+        if c['result'] in ('SKIP', 'CACHED'):
             continue
-        case_durs = stats.get(c['name'], [])
-        case_durs.append(c['duration'].total_seconds())
-        if len(case_durs) > 10:
-            del case_durs[0 : len(case_durs) - 10]
-        stats[c['name']] = case_durs
+        appendStat(stats, f"{c['name']}#failed", 0)
+        appendStat(stats, c['name'], c['duration'].total_seconds())
+        usage = c.get('rusage')
+        if usage is not None:
+            for k in ['maxrss', 'utime', 'stime']:
+                appendStat(stats, f"{c['name']}#{k}", usage[k])
+        for p in c.get('records', {}).get('perf', []):
+            for k in PERF_COUNTERS:
+                if k in p:
+                    appendStat(stats, f"{c['name']}#{k}", p[k])
     with open(opts.dir / 'stats.json', 'w') as fp:
         json.dump(stats, fp, sort_keys=True)
 
+def sandboxCommand(cwd):
+    """A command prefix running a case in new mount, network and pid namespaces,
+    and a new user namespace too, unless runtests.py runs as root.
+    Inside, runtests.py itself, as subcommand `sandbox`, sets mounts and network up,
+    and then executes the case."""
+    args = ['unshare', '--mount', '--net', '--pid', '--fork', '--kill-child', '--mount-proc']
+    if os.geteuid() != 0:
+        args += ['--user', '--map-root-user']
+    args += [sys.executable, str(Path(__file__).absolute()), 'sandbox', str(Path(cwd).absolute()), '--']
+    return shlex.join(args)
+
+SIOCGIFFLAGS = 0x8913
+SIOCSIFFLAGS = 0x8914
+IFF_UP = 0x1
+
+def mount(source, target, fstype, data):
+    libc = ctypes.CDLL(None, use_errno=True)
+    if libc.mount(source.encode(), str(target).encode(), fstype.encode(), 0, data.encode()) != 0:
+        err = ctypes.get_errno()
+        raise OSError(err, f'mount {fstype} on {target}: {os.strerror(err)}')
+
+def sandbox(argv):
+    """Subcommand `sandbox DIR -- PROGRAM ARGS...`, run by `unshare` as sandboxCommand describes.
+    It mounts a tmpfs on /tmp, and an overlay on DIR, whose writes go to the tmpfs,
+    brings the loopback up, and then executes the program in DIR.
+    All of them are gone once the program exits."""
+    # Mounts made out of namespaces of its own would be seen by the whole machine.
+    if os.getpid() != 1:
+        error('sandbox is run by unshare only, as the first process of a new pid namespace')
+    cwd = Path(argv[0])
+    args = argv[2:]
+    # DIR may be under /tmp, which is hidden by the tmpfs, so it is kept open as the lower layer.
+    lower = os.open(cwd, os.O_PATH | os.O_DIRECTORY)
+    mount('tmpfs', '/tmp', 'tmpfs', 'mode=1777')
+    upper = Path('/tmp/.testa-sandbox/upper')
+    work = Path('/tmp/.testa-sandbox/work')
+    upper.mkdir(parents=True)
+    work.mkdir(parents=True)
+    cwd.mkdir(parents=True, exist_ok=True)
+    mount('overlay', cwd, 'overlay',
+        f'lowerdir=/proc/self/fd/{lower},upperdir={upper},workdir={work}')
+    os.close(lower)
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        ifr = struct.pack('16sH', b'lo', 0)
+        flags = struct.unpack('16sH', fcntl.ioctl(sock, SIOCGIFFLAGS, ifr)[:18])[1]
+        fcntl.ioctl(sock, SIOCSIFFLAGS, struct.pack('16sH', b'lo', flags | IFF_UP))
+    os.chdir(cwd)
+    os.execvp(args[0], args)
+
+def extract(argv):
+    """Subcommand `extract`, which prints output of cases of the last run."""
+    parser = argparse.ArgumentParser(prog=f'{sys.argv[0]} extract',
+        description='Print stdout (or stderr) of test cases, e.g., "cpp_unittest/CorrectGcd"')
+    parser.add_argument('cases', metavar='case', type=str, nargs='+',
+                        help='names of cases, as they are reported')
+    parser.add_argument('-d', '--dir', nargs='?', default='test_results',
+                        help='the directory where results of test cases are put [default: test_results]')
+    parser.add_argument('--stderr', action='store_true',
+                        help='print stderr rather than stdout')
+    args = parser.parse_args(argv)
+    testDir = Path(args.dir).absolute()
+    store = OutputStore(testDir)
+    key = 'stderr' if args.stderr else 'stdout'
+    for name in args.cases:
+        locs = store.locate(name)
+        # falls back to files of `--per-case-files`
+        loc = locs[key] if locs is not None else testDir / (name + ('.err' if args.stderr else '.out'))
+        try:
+            sys.stdout.buffer.write(readOutput(loc))
+        except OSError as ex:
+            error(f'no output of {name}: {ex}')
+    sys.stdout.flush()
+
 if __name__ == '__main__':
+    if sys.argv[1:2] == ['extract']:
+        extract(sys.argv[2:])
+        exit(0)
+    if sys.argv[1:2] == ['sandbox']:
+        sandbox(sys.argv[2:])
     opts = parseArgs()
     langs = readLangCfg(opts.lang)
 
@@ -350,15 +1316,40 @@ if __name__ == '__main__':
     try:
         cases = collectCases(opts, langs, reqQ, resQ)
         cases = filterCases(opts, cases)
+        coverage = CoverageIndex(opts)
+        if opts.changed:
+            total = len(cases)
+            cases = coverage.affected(cases, opts.changed)
+            print('%d of %d cases are affected by changed files' % (len(cases), total))
+        results = ResultCache(opts)
+        cached = []
+        if not opts.force:
+            cached, cases = results.split(cases)
         dispatchCases(opts, cases, reqQ)
-        passed, failed = collectResults(opts, cases, resQ)
+        passed = reportCached(opts, cached)
+        more, failed = collectResults(opts, cases, resQ)
+        passed += more
         writeOutStats(opts, passed, failed)
+        results.update(passed, failed)
+        results.save()
+        if opts.outputs is not None:
+            opts.outputs.update(passed + failed)
+            opts.outputs.save()
+        if opts.record_coverage:
+            coverage.update(passed + failed)
+            coverage.save()
+            shutil.rmtree(opts.dir / 'gcov', ignore_errors=True)
         print()
+        if gCancelled:
+            print('stopped by --fail-fast or --max-failures, %d of %d cases have no results' % (
+                len(cases) - len(more) - len(failed), len(cases)))
         print('%d failed' % len(failed))
         for x in failed:
             print(x['name'])
             print('  stdout:', x['stdout'])
             print('  stderr:', x['stderr'])
+        if failed and opts.outputs is not None:
+            print(f'extract outputs by `{sys.argv[0]} extract -d {opts.dir} CASE`')
         if opts.report:
             report(opts.report, passed + failed)
             print()